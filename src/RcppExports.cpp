@@ -6,18 +6,61 @@
 using namespace Rcpp;
 
 // DrawingDevice
-void DrawingDevice(double width, double height, double pointsize, std::string font);
-RcppExport SEXP _RDrawing_DrawingDevice(SEXP widthSEXP, SEXP heightSEXP, SEXP pointsizeSEXP, SEXP fontSEXP) {
+void DrawingDevice(double width, double height, double pointsize, std::string font, double memory_budget, std::string diagnostics, std::string record, std::string cache, double cache_size, std::string metrics_cache);
+RcppExport SEXP _RDrawing_DrawingDevice(SEXP widthSEXP, SEXP heightSEXP, SEXP pointsizeSEXP, SEXP fontSEXP, SEXP memory_budgetSEXP, SEXP diagnosticsSEXP, SEXP recordSEXP, SEXP cacheSEXP, SEXP cache_sizeSEXP, SEXP metrics_cacheSEXP) {
 BEGIN_RCPP
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< double >::type width(widthSEXP);
     Rcpp::traits::input_parameter< double >::type height(heightSEXP);
     Rcpp::traits::input_parameter< double >::type pointsize(pointsizeSEXP);
     Rcpp::traits::input_parameter< std::string >::type font(fontSEXP);
-    DrawingDevice(width, height, pointsize, font);
+    Rcpp::traits::input_parameter< double >::type memory_budget(memory_budgetSEXP);
+    Rcpp::traits::input_parameter< std::string >::type diagnostics(diagnosticsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type record(recordSEXP);
+    Rcpp::traits::input_parameter< std::string >::type cache(cacheSEXP);
+    Rcpp::traits::input_parameter< double >::type cache_size(cache_sizeSEXP);
+    Rcpp::traits::input_parameter< std::string >::type metrics_cache(metrics_cacheSEXP);
+    DrawingDevice(width, height, pointsize, font, memory_budget, diagnostics, record, cache, cache_size, metrics_cache);
     return R_NilValue;
 END_RCPP
 }
+// DrawingReplay
+void DrawingReplay(std::string path, double memory_budget, std::string diagnostics);
+RcppExport SEXP _RDrawing_DrawingReplay(SEXP pathSEXP, SEXP memory_budgetSEXP, SEXP diagnosticsSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< double >::type memory_budget(memory_budgetSEXP);
+    Rcpp::traits::input_parameter< std::string >::type diagnostics(diagnosticsSEXP);
+    DrawingReplay(path, memory_budget, diagnostics);
+    return R_NilValue;
+END_RCPP
+}
+// DrawingStats
+Rcpp::List DrawingStats();
+RcppExport SEXP _RDrawing_DrawingStats() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(DrawingStats());
+    return rcpp_result_gen;
+END_RCPP
+}
+// DrawingTextMetrics
+Rcpp::NumericMatrix DrawingTextMetrics(Rcpp::CharacterVector text, Rcpp::CharacterVector family, Rcpp::IntegerVector fontface, Rcpp::NumericVector size, int threads);
+RcppExport SEXP _RDrawing_DrawingTextMetrics(SEXP textSEXP, SEXP familySEXP, SEXP fontfaceSEXP, SEXP sizeSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::CharacterVector >::type text(textSEXP);
+    Rcpp::traits::input_parameter< Rcpp::CharacterVector >::type family(familySEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type fontface(fontfaceSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type size(sizeSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(DrawingTextMetrics(text, family, fontface, size, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
 // ZipAndSendToClipboard
 void ZipAndSendToClipboard(Rcpp::Environment archive);
 RcppExport SEXP _RDrawing_ZipAndSendToClipboard(SEXP archiveSEXP) {
@@ -30,7 +73,10 @@ END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_RDrawing_DrawingDevice", (DL_FUNC) &_RDrawing_DrawingDevice, 4},
+    {"_RDrawing_DrawingDevice", (DL_FUNC) &_RDrawing_DrawingDevice, 10},
+    {"_RDrawing_DrawingReplay", (DL_FUNC) &_RDrawing_DrawingReplay, 3},
+    {"_RDrawing_DrawingStats", (DL_FUNC) &_RDrawing_DrawingStats, 0},
+    {"_RDrawing_DrawingTextMetrics", (DL_FUNC) &_RDrawing_DrawingTextMetrics, 5},
     {"_RDrawing_ZipAndSendToClipboard", (DL_FUNC) &_RDrawing_ZipAndSendToClipboard, 1},
     {NULL, NULL, 0}
 };
@@ -0,0 +1,107 @@
+// Compact binary encoding helpers shared by the spill log and other on-disk formats
+#pragma once
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+struct Drawing_BinaryWriter {
+  std::string &data;
+
+  Drawing_BinaryWriter(std::string &data) : data(data) {}
+
+  void put_u8(uint8_t v) {
+    data.push_back(static_cast<char>(v));
+  }
+
+  // LEB128 style variable length integer
+  void put_varint(uint64_t v) {
+    while (v >= 0x80) {
+      data.push_back(static_cast<char>((v & 0x7F) | 0x80));
+      v >>= 7;
+    }
+    data.push_back(static_cast<char>(v));
+  }
+
+  // Zigzag encoding keeps small negative values small
+  void put_svarint(int64_t v) {
+    put_varint((static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+  }
+
+  void put_u32(uint32_t v) {
+    char buffer[4];
+    std::memcpy(buffer, &v, sizeof(v));
+    data.append(buffer, sizeof(buffer));
+  }
+
+  void put_double(double v) {
+    char buffer[8];
+    std::memcpy(buffer, &v, sizeof(v));
+    data.append(buffer, sizeof(buffer));
+  }
+
+  void put_string(const std::string &v) {
+    put_varint(v.size());
+    data.append(v);
+  }
+};
+
+struct Drawing_BinaryReader {
+  const uint8_t *pos;
+  const uint8_t *end;
+
+  Drawing_BinaryReader(const uint8_t *data, std::size_t size) : pos(data), end(data + size) {}
+
+  bool eof() const { return pos >= end; }
+
+  uint8_t get_u8() {
+    need(1);
+    return *pos++;
+  }
+
+  uint64_t get_varint() {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      uint8_t byte = get_u8();
+      v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) return v;
+    }
+
+    throw std::runtime_error("Malformed varint in binary stream");
+  }
+
+  int64_t get_svarint() {
+    uint64_t v = get_varint();
+    return static_cast<int64_t>((v >> 1) ^ (~(v & 1) + 1));
+  }
+
+  uint32_t get_u32() {
+    uint32_t v;
+    need(sizeof(v));
+    std::memcpy(&v, pos, sizeof(v));
+    pos += sizeof(v);
+    return v;
+  }
+
+  double get_double() {
+    double v;
+    need(sizeof(v));
+    std::memcpy(&v, pos, sizeof(v));
+    pos += sizeof(v);
+    return v;
+  }
+
+  std::string get_string() {
+    uint64_t length = get_varint();
+    need(length);
+    std::string v(reinterpret_cast<const char *>(pos), length);
+    pos += length;
+    return v;
+  }
+
+private:
+  void need(uint64_t bytes) {
+    if (static_cast<uint64_t>(end - pos) < bytes)
+      throw std::runtime_error("Unexpected end of binary stream");
+  }
+};
@@ -0,0 +1,82 @@
+#include <Rcpp.h>
+#include "diagnostics.h"
+
+struct Drawing_MessageInfo {
+  Drawing_DiagnosticLevel level;
+  const char *summary;
+};
+
+static const Drawing_MessageInfo Drawing_Messages[DRAWING_MSG_COUNT] = {
+  {DRAWING_DIAG_WARNING, "text too small to draw"},
+  {DRAWING_DIAG_DEBUG, "metric queries for unicode characters"},
+  {DRAWING_DIAG_DEBUG, "strings drawn in the symbol font"}
+};
+
+static const char *Drawing_DiagnosticLevel_str(Drawing_DiagnosticLevel level) {
+  switch (level) {
+    case DRAWING_DIAG_OFF: return "off";
+    case DRAWING_DIAG_ERROR: return "error";
+    case DRAWING_DIAG_WARNING: return "warning";
+    case DRAWING_DIAG_INFO: return "info";
+    case DRAWING_DIAG_DEBUG: return "debug";
+  }
+
+  return "";
+}
+
+Drawing_DiagnosticLevel Drawing_DiagnosticLevel_parse(const std::string &level) {
+  if (level == "off" || level == "none") return DRAWING_DIAG_OFF;
+  if (level == "error") return DRAWING_DIAG_ERROR;
+  if (level == "warning") return DRAWING_DIAG_WARNING;
+  if (level == "info") return DRAWING_DIAG_INFO;
+  if (level == "debug") return DRAWING_DIAG_DEBUG;
+
+  throw std::invalid_argument("Unknown diagnostics level '" + level + "'");
+}
+
+Drawing_Diagnostics::Drawing_Diagnostics(Drawing_DiagnosticLevel level, std::size_t rate_limit) {
+  this->level = level;
+  this->rate_limit = rate_limit;
+  reset();
+}
+
+bool Drawing_Diagnostics::enabled(Drawing_Message message) const {
+  return Drawing_Messages[message].level <= level;
+}
+
+void Drawing_Diagnostics::print(Drawing_Message message, const std::string &text) {
+  Counter &counter = counters[message];
+  counter.printed++;
+
+  Rcpp::Rcerr << "DrawingDevice [" << Drawing_DiagnosticLevel_str(Drawing_Messages[message].level) << "]: " << text;
+  if (counter.printed == rate_limit)
+    Rcpp::Rcerr << " (further messages suppressed)";
+  Rcpp::Rcerr << "\n";
+}
+
+// Lists every enabled message that was suppressed; at info level and above, every message seen
+void Drawing_Diagnostics::summary() {
+  bool header = false;
+
+  for (int message = 0; message < DRAWING_MSG_COUNT; message++) {
+    const Counter &counter = counters[message];
+    if (counter.count == 0) continue;
+    if (!enabled(static_cast<Drawing_Message>(message))) continue;
+    if ((counter.count == counter.printed) && (level < DRAWING_DIAG_INFO)) continue;
+
+    if (!header) {
+      Rcpp::Rcerr << "DrawingDevice diagnostics summary:\n";
+      header = true;
+    }
+
+    Rcpp::Rcerr << "  " << counter.count << " x " << Drawing_Messages[message].summary;
+    if (counter.count > counter.printed)
+      Rcpp::Rcerr << " (" << counter.count - counter.printed << " not shown)";
+    Rcpp::Rcerr << "\n";
+  }
+}
+
+void Drawing_Diagnostics::reset() {
+  for (auto &counter : counters)
+    counter = {0, 0};
+}
@@ -0,0 +1,59 @@
+// Device diagnostics. Every message is counted (a single increment), but it is only
+// formatted and printed when its level is enabled, and then only for the first
+// few occurrences. A summary of counts is printed when the device closes.
+#pragma once
+#include <string>
+#include <sstream>
+#include <array>
+
+enum Drawing_DiagnosticLevel {
+  DRAWING_DIAG_OFF = 0,
+  DRAWING_DIAG_ERROR = 1,
+  DRAWING_DIAG_WARNING = 2,
+  DRAWING_DIAG_INFO = 3,
+  DRAWING_DIAG_DEBUG = 4
+};
+
+enum Drawing_Message {
+  DRAWING_MSG_TEXT_TOO_SMALL,
+  DRAWING_MSG_UNICODE_METRIC,
+  DRAWING_MSG_SYMBOL_TEXT,
+  DRAWING_MSG_COUNT
+};
+
+Drawing_DiagnosticLevel Drawing_DiagnosticLevel_parse(const std::string &level);
+
+class Drawing_Diagnostics {
+  struct Counter {
+    std::size_t count;
+    std::size_t printed;
+  };
+
+  Drawing_DiagnosticLevel level;
+  std::size_t rate_limit;
+  std::array<Counter, DRAWING_MSG_COUNT> counters;
+
+  void print(Drawing_Message message, const std::string &text);
+
+public:
+  Drawing_Diagnostics(Drawing_DiagnosticLevel level = DRAWING_DIAG_WARNING, std::size_t rate_limit = 5);
+
+  void setLevel(Drawing_DiagnosticLevel level) { this->level = level; }
+  bool enabled(Drawing_Message message) const;
+
+  // format is only called when the message will be printed
+  template<typename Format>
+  void report(Drawing_Message message, Format format) {
+    Counter &counter = counters[message];
+    counter.count++;
+
+    if ((counter.printed < rate_limit) && enabled(message)) {
+      std::ostringstream text;
+      format(text);
+      print(message, text.str());
+    }
+  }
+
+  void summary();
+  void reset();
+};
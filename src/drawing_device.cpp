@@ -1,26 +1,62 @@
 #include <Rcpp.h>
 #include <cmath>
+#include <cstring>
 #include <algorithm>
 #include "drawing_device.h"
 #include "drawingml.h"
 #include "zip_container.h"
 #define UTF_CPP_CPLUSPLUS 201703L
-#include "utf8.h"
 
 const double Drawing_FontHeightScalar = 277.0 / 90.0 / 2.54;
+const std::chrono::milliseconds Drawing_ProgressInterval(1000);
 
 //' @export
 // [[Rcpp::export]]
 void DrawingDevice(double width = 23.5 / 2.54, double height = 14.5 / 2.54,
-                   double pointsize = 10, std::string font = "Arial") {
+                   double pointsize = 10, std::string font = "Arial",
+                   double memory_budget = 0, std::string diagnostics = "warning",
+                   std::string record = "", std::string cache = "", double cache_size = 256,
+                   std::string metrics_cache = "") {
 
   if (std::isnan(width) || (width <= 0)) width = 23.5 / 2.54;
   if (std::isnan(height) || (height <= 0)) height = 14.5 / 2.54;
   if (std::isnan(pointsize) || (pointsize <= 0)) pointsize = 10;
+  if (std::isnan(memory_budget) || (memory_budget < 0)) memory_budget = 0;
+  Drawing_DiagnosticLevel diagnostics_level = Drawing_DiagnosticLevel_parse(diagnostics);
 
+  // These raise R errors, which would skip the destructors of anything created below
   R_GE_checkVersionOrDie(R_GE_version);
   R_CheckDeviceAvailable();
 
+  // Shapes beyond the memory budget (in MB) are spilled to a file in the session's temporary directory;
+  // the serialised XML and archive are not covered by the budget
+  std::string spill_path;
+  if (memory_budget > 0) {
+    Rcpp::Function tempfile("tempfile");
+    spill_path = Rcpp::as<std::string>(tempfile("RDrawing", Rcpp::Named("fileext") = ".spill"));
+  }
+
+  // Finished archives are kept in the cache directory, up to cache_size MB
+  std::unique_ptr<Drawing_OutputCache> output_cache;
+  if (!cache.empty()) {
+    if (std::isnan(cache_size) || (cache_size < 0)) cache_size = 0;
+    output_cache.reset(new Drawing_OutputCache(cache, static_cast<std::size_t>(cache_size * 1024 * 1024)));
+  }
+
+  // Archives made by another version of the package are not reused
+  std::string package_version;
+  if (output_cache) {
+    Rcpp::Function packageVersion("packageVersion");
+    Rcpp::Function asCharacter("as.character");
+    package_version = Rcpp::as<std::string>(asCharacter(packageVersion("RDrawing")));
+  }
+
+  // Every callback is also written to the recording, for Drawing_Replayer. Its hash, with
+  // the package version and the fonts text is measured with, is the cache key.
+  std::unique_ptr<Drawing_Recorder> recorder;
+  if (!record.empty() || output_cache)
+    recorder.reset(new Drawing_Recorder(record, {width, height, pointsize, font}));
+
   BEGIN_SUSPEND_INTERRUPTS {
     pGEDevDesc gdd;
     pDevDesc dev;
@@ -100,7 +136,25 @@ void DrawingDevice(double width = 23.5 / 2.54, double height = 14.5 / 2.54,
     dev->setMask = DrawingDevice_setMask;
     dev->releaseMask = DrawingDevice_releaseMask;
 
-    dev->deviceSpecific = new DrawingML_Context();
+    DrawingML_Context *context = new DrawingML_Context();
+    context->objects.setBudget(static_cast<std::size_t>(memory_budget * 1024 * 1024), spill_path);
+    context->diagnostics.setLevel(diagnostics_level);
+    context->recorder = std::move(recorder);
+    context->cache = std::move(output_cache);
+    if (!metrics_cache.empty()) context->platform->OpenMetricsCache(metrics_cache);
+    if (context->cache) {
+      context->cache_environment = package_version + '\0' + context->platform->MetricsFingerprint() + '\0' + metrics_cache;
+    }
+
+    R_GE_gcontext font_gc;
+    std::memset(&font_gc, 0, sizeof(font_gc));
+    std::strncpy(font_gc.fontfamily, font.c_str(), sizeof(font_gc.fontfamily) - 1);
+    font_gc.fontface = 1;
+    // Families with built-in metrics do not go through the font backend for Latin-1
+    // text, and warming them up would only hold the font service lock for nothing
+    const std::string& family = context->platform->FontFamily(&font_gc);
+    if (!CoreFontFamily(family)) context->platform->WarmUp(family);
+    dev->deviceSpecific = context;
 
     gdd = GEcreateDevDesc(dev);
     GEaddDevice2(gdd, "DrawingDevice");
@@ -155,7 +209,20 @@ std::string Drawing_LineType_str(Drawing_LineType lty) {
   return "solid";
 }
 
-Drawing_Attributes::Drawing_Attributes(const PlatformDeviceDriver &platform, const pGEcontext gc) {
+Drawing_Attributes::Drawing_Attributes() {
+  lineWidth = 1;
+  lineType = DRAWING_LINE_SOLID;
+  lineEnd = DRAWING_ROUND_CAP;
+  lineJoin = DRAWING_ROUND_JOIN;
+  lineMitre = 10;
+  pointSize = 0;
+  hAdjustment = 0;
+  rotation = 0;
+  bold = false;
+  italic = false;
+}
+
+Drawing_Attributes::Drawing_Attributes(const pGEcontext gc) : Drawing_Attributes() {
   if (gc) {
     lineColour = gc->col;
     fillColour = gc->fill;
@@ -164,14 +231,302 @@ Drawing_Attributes::Drawing_Attributes(const PlatformDeviceDriver &platform, con
     lineEnd = static_cast<Drawing_LineEnd>(gc->lend);
     lineJoin = static_cast<Drawing_LineJoin>(gc->ljoin);
     lineMitre = gc->lmitre;
+  }
+}
+
+Drawing_Attributes::Drawing_Attributes(const PlatformDeviceDriver &platform, const pGEcontext gc) : Drawing_Attributes(gc) {
+  if (gc) {
     pointSize = gc->ps * gc->cex;
     bold = gc->fontface == 2 || gc->fontface == 4;
     italic = gc->fontface == 3 || gc->fontface == 4;
-    font = platform.PlatformFontFamily(gc);
+    font = platform.FontFamily(gc);
+  }
+}
+
+static void encode_colour(Drawing_BinaryWriter &out, const Drawing_Colour &colour) {
+  out.put_u32(R_RGBA(colour.red, colour.green, colour.blue, colour.alpha));
+}
+
+static Drawing_Colour decode_colour(Drawing_BinaryReader &in) {
+  uint32_t v = in.get_u32();
+  Drawing_Colour colour;
+  colour.red = R_RED(v);
+  colour.green = R_GREEN(v);
+  colour.blue = R_BLUE(v);
+  colour.alpha = R_ALPHA(v);
+
+  return colour;
+}
+
+static void encode_attributes(Drawing_BinaryWriter &out, const Drawing_Attributes &attributes, bool font) {
+  encode_colour(out, attributes.lineColour);
+  encode_colour(out, attributes.fillColour);
+  out.put_double(attributes.lineWidth);
+  out.put_svarint(attributes.lineType);
+  out.put_varint(attributes.lineEnd);
+  out.put_varint(attributes.lineJoin);
+  out.put_double(attributes.lineMitre);
+
+  if (font) {
+    out.put_double(attributes.pointSize);
+    out.put_double(attributes.hAdjustment);
+    out.put_double(attributes.rotation);
+    out.put_u8((attributes.bold ? 1 : 0) | (attributes.italic ? 2 : 0));
+    out.put_string(attributes.font);
   }
 }
 
-Drawing_Context::Drawing_Context() {
+static Drawing_Attributes decode_attributes(Drawing_BinaryReader &in, bool font) {
+  Drawing_Attributes attributes;
+  attributes.lineColour = decode_colour(in);
+  attributes.fillColour = decode_colour(in);
+  attributes.lineWidth = in.get_double();
+  attributes.lineType = static_cast<Drawing_LineType>(in.get_svarint());
+  attributes.lineEnd = static_cast<Drawing_LineEnd>(in.get_varint());
+  attributes.lineJoin = static_cast<Drawing_LineJoin>(in.get_varint());
+  attributes.lineMitre = in.get_double();
+
+  if (font) {
+    attributes.pointSize = in.get_double();
+    attributes.hAdjustment = in.get_double();
+    attributes.rotation = in.get_double();
+    uint8_t style = in.get_u8();
+    attributes.bold = (style & 1) != 0;
+    attributes.italic = (style & 2) != 0;
+    attributes.font = in.get_string();
+  }
+
+  return attributes;
+}
+
+static void encode_points(Drawing_BinaryWriter &out, const std::vector<std::pair<double, double>> &points) {
+  out.put_varint(points.size());
+  for (const auto &[x, y] : points) {
+    out.put_double(x);
+    out.put_double(y);
+  }
+}
+
+static std::vector<std::pair<double, double>> decode_points(Drawing_BinaryReader &in) {
+  std::vector<std::pair<double, double>> points(in.get_varint());
+  for (auto &[x, y] : points) {
+    x = in.get_double();
+    y = in.get_double();
+  }
+
+  return points;
+}
+
+void Drawing_Group::encode(Drawing_BinaryWriter &out) const {
+  out.put_u8(DRAWING_GEOM_GROUP);
+  out.put_svarint(id);
+  out.put_string(name);
+  out.put_double(x);
+  out.put_double(y);
+  out.put_double(width);
+  out.put_double(height);
+  out.put_varint(interior_objects.size());
+  for (const auto &object : interior_objects)
+    object->encode(out);
+}
+
+std::size_t Drawing_Group::footprint() const {
+  std::size_t bytes = sizeof(*this) + name.capacity() + interior_objects.capacity() * sizeof(interior_objects[0]);
+  for (const auto &object : interior_objects)
+    bytes += object->footprint();
+
+  return bytes;
+}
+
+void Drawing_Rect::encode(Drawing_BinaryWriter &out) const {
+  out.put_u8(DRAWING_GEOM_RECT);
+  out.put_svarint(id);
+  out.put_double(x0);
+  out.put_double(y0);
+  out.put_double(x1);
+  out.put_double(y1);
+  encode_attributes(out, attributes, false);
+}
+
+std::size_t Drawing_Rect::footprint() const {
+  return sizeof(*this) + name.capacity() + attributes.font.capacity();
+}
+
+void Drawing_Line::encode(Drawing_BinaryWriter &out) const {
+  out.put_u8(DRAWING_GEOM_LINE);
+  out.put_svarint(id);
+  out.put_double(x1);
+  out.put_double(y1);
+  out.put_double(x2);
+  out.put_double(y2);
+  encode_attributes(out, attributes, false);
+}
+
+std::size_t Drawing_Line::footprint() const {
+  return sizeof(*this) + name.capacity() + attributes.font.capacity();
+}
+
+void Drawing_Circle::encode(Drawing_BinaryWriter &out) const {
+  out.put_u8(DRAWING_GEOM_CIRCLE);
+  out.put_svarint(id);
+  out.put_double(x);
+  out.put_double(y);
+  out.put_double(radius);
+  encode_attributes(out, attributes, false);
+}
+
+std::size_t Drawing_Circle::footprint() const {
+  return sizeof(*this) + name.capacity() + attributes.font.capacity();
+}
+
+void Drawing_Polyline::encode(Drawing_BinaryWriter &out) const {
+  out.put_u8(DRAWING_GEOM_POLYLINE);
+  out.put_svarint(id);
+  encode_points(out, points);
+  encode_attributes(out, attributes, false);
+}
+
+std::size_t Drawing_Polyline::footprint() const {
+  return sizeof(*this) + name.capacity() + attributes.font.capacity() + points.capacity() * sizeof(points[0]);
+}
+
+void Drawing_Polygon::encode(Drawing_BinaryWriter &out) const {
+  out.put_u8(DRAWING_GEOM_POLYGON);
+  out.put_svarint(id);
+  encode_points(out, points);
+  encode_attributes(out, attributes, false);
+}
+
+std::size_t Drawing_Polygon::footprint() const {
+  return sizeof(*this) + name.capacity() + attributes.font.capacity() + points.capacity() * sizeof(points[0]);
+}
+
+void Drawing_Text::encode(Drawing_BinaryWriter &out) const {
+  out.put_u8(DRAWING_GEOM_TEXT);
+  out.put_svarint(id);
+  out.put_double(x0);
+  out.put_double(y0);
+  out.put_double(x1);
+  out.put_double(y1);
+  out.put_string(text);
+  out.put_double(align.align);
+  encode_attributes(out, attributes, true);
+}
+
+std::size_t Drawing_Text::footprint() const {
+  return sizeof(*this) + name.capacity() + attributes.font.capacity() + text.capacity();
+}
+
+void Drawing_Context::decode(Drawing_BinaryReader &in) {
+  Drawing_GeomKind kind = static_cast<Drawing_GeomKind>(in.get_u8());
+  int id = static_cast<int>(in.get_svarint());
+
+  switch (kind) {
+    case DRAWING_GEOM_GROUP: {
+      std::string name = in.get_string();
+      double x = in.get_double();
+      double y = in.get_double();
+      double width = in.get_double();
+      double height = in.get_double();
+      std::size_t count = in.get_varint();
+      for (std::size_t idx = 0; idx < count; idx++)
+        decode(in);
+
+      std::vector<std::shared_ptr<Drawing_Geom>> interior_objects = objects.takeLast(count);
+      group(id, x, y, width, height, name, interior_objects);
+      break;
+    }
+
+    case DRAWING_GEOM_RECT: {
+      double x0 = in.get_double();
+      double y0 = in.get_double();
+      double x1 = in.get_double();
+      double y1 = in.get_double();
+      rect(id, x0, y0, x1, y1, decode_attributes(in, false));
+      break;
+    }
+
+    case DRAWING_GEOM_LINE: {
+      double x1 = in.get_double();
+      double y1 = in.get_double();
+      double x2 = in.get_double();
+      double y2 = in.get_double();
+      line(id, x1, y1, x2, y2, decode_attributes(in, false));
+      break;
+    }
+
+    case DRAWING_GEOM_CIRCLE: {
+      double x = in.get_double();
+      double y = in.get_double();
+      double radius = in.get_double();
+      circle(id, x, y, radius, decode_attributes(in, false));
+      break;
+    }
+
+    case DRAWING_GEOM_POLYLINE: {
+      std::vector<std::pair<double, double>> points = decode_points(in);
+      polyline(id, std::move(points), decode_attributes(in, false));
+      break;
+    }
+
+    case DRAWING_GEOM_POLYGON: {
+      std::vector<std::pair<double, double>> points = decode_points(in);
+      polygon(id, std::move(points), decode_attributes(in, false));
+      break;
+    }
+
+    case DRAWING_GEOM_TEXT: {
+      double x0 = in.get_double();
+      double y0 = in.get_double();
+      double x1 = in.get_double();
+      double y1 = in.get_double();
+      std::string text = in.get_string();
+      double align = in.get_double();
+      this->text(id, x0, y0, x1, y1, text, align, decode_attributes(in, true));
+      break;
+    }
+
+    default:
+      throw std::runtime_error("Unknown shape in spill log");
+  }
+}
+
+Drawing_Progress::Drawing_Progress(std::size_t shapes_total) {
+  this->shapes_total = shapes_total;
+  shapes_done = 0;
+  bytes_done = 0;
+  reported = false;
+  last_report = std::chrono::steady_clock::now();
+}
+
+void Drawing_Progress::update(std::size_t shapes, std::size_t bytes) {
+  shapes_done = shapes;
+  bytes_done = bytes;
+
+  Rcpp::checkUserInterrupt();
+
+  // Only report on exports that take long enough to notice
+  auto now = std::chrono::steady_clock::now();
+  if ((now - last_report) >= Drawing_ProgressInterval) {
+    last_report = now;
+    report();
+  }
+}
+
+void Drawing_Progress::finish() {
+  if (reported) {
+    report();
+    Rcpp::Rcout << "\n";
+  }
+}
+
+void Drawing_Progress::report() {
+  reported = true;
+  Rcpp::Rcout << "\rDrawingDevice: " << shapes_done << " of " << shapes_total << " shapes, "
+              << (bytes_done >> 10) << " KB" << std::flush;
+}
+
+Drawing_Context::Drawing_Context() : objects(*this) {
   platform = NewPlatformDeviceDriver();
 }
 
@@ -193,9 +548,46 @@ void DrawingDevice_close(pDevDesc dd) {
   if (dd == NULL) return;
   Drawing_Context *context = (Drawing_Context *)dd->deviceSpecific;
   if (context == NULL) return;
+  std::string failure;
+
+  context->diagnostics.summary();
 
   try {
-    ZipAndSendToClipboard(context->container());
+    if (context->recorder) context->recorder->close();
+    context->platform->SaveMetricsCache();
+
+    // An identical call stream was exported before; reuse its archive
+    std::vector<uint8_t> archive;
+    std::string key;
+    if (context->cache) {
+      Drawing_StreamHash hash;
+      std::string digest = context->recorder->digest();
+      hash.update(digest.data(), digest.size());
+      hash.update(context->cache_environment.data(), context->cache_environment.size());
+      key = hash.str();
+      context->stats.cache_hit = context->cache->lookup(key, archive);
+
+      Drawing_OutputCacheStats.lookups++;
+      if (context->stats.cache_hit) {
+        Drawing_OutputCacheStats.hits++;
+        Drawing_OutputCacheStats.bytes_saved += archive.size();
+        context->stats.archive_bytes = archive.size();
+      }
+    }
+
+    if (!context->stats.cache_hit) {
+      std::vector<std::pair<std::string, std::string>> container;
+      {
+        Drawing_ScopedTimer timer(context->stats, DRAWING_TIME_XML);
+        container = context->container();
+      }
+
+      archive = ZipContainer(container, context->stats);
+      if (context->cache) context->cache->store(key, archive);
+    }
+
+    SendArchiveToClipboard(archive, context->stats);
+    Drawing_LastStats = context->stats;
 
     // explicitly delete, and set to NULL
     // otherwise R will try to free dd->deviceSpecific...
@@ -203,14 +595,28 @@ void DrawingDevice_close(pDevDesc dd) {
     dd->deviceSpecific = NULL;
   }
 
+  catch (Rcpp::internal::InterruptedException&) {
+    // Partially serialised parts have been released by unwinding; drop the shapes too
+    context->stats.interrupted = true;
+    Drawing_LastStats = context->stats;
+    delete context;
+    dd->deviceSpecific = NULL;
+    failure = "export interrupted, nothing was copied to the clipboard";
+  }
+
   catch (const std::exception& e) {
     if (dd->deviceSpecific) {
+      Drawing_LastStats = context->stats;
       delete context;
       dd->deviceSpecific = NULL;
     }
 
-    throw Rcpp::exception(e.what());
+    failure = e.what();
   }
+
+  // close is called from R's device list code, which must run to completion to free
+  // the device, so failures are reported as a warning rather than an error
+  if (!failure.empty()) Rf_warning("DrawingDevice: %s", failure.c_str());
 }
 
 void DrawingDevice_mode(int mode, pDevDesc dd) {
@@ -236,45 +642,27 @@ void DrawingDevice_newPage(const pGEcontext gc, pDevDesc dd) {
   Drawing_Context *context = (Drawing_Context *)dd->deviceSpecific;
   if (context == NULL) return;
 
-  context->initialise(dd->right, dd->bottom);
+  if (context->recorder) context->recorder->newPage(dd->right, dd->bottom);
+  Drawing_newPage(*context, dd->right, dd->bottom);
 }
 
 void DrawingDevice_metricInfo(int c, const pGEcontext gc, double *ascent, double *descent, double *width, pDevDesc dd) {
   *ascent = *descent = *width = 0.0;
-  if (gc == NULL) return;
-
-  std::string str;
-
-  // Because hasUTF8 is set to TRUE, when c < 0 it's a unicode point
-  if (c < 0) {
-    Rcpp::Rcout << "Was asked about a unicode character -- " << -c << "\n";
-    utf8::append(-c, str);
-  } else
-    str.push_back(c);
-
-  Drawing_TextBounds bounds;
+  if (dd == NULL) return;
   Drawing_Context *context = (Drawing_Context *)dd->deviceSpecific;
   if (context == NULL) return;
-  if (context->platform == nullptr) return;
-  context->platform->TextBoundingRect(gc, str, true, bounds);
 
-  *descent = -bounds.descent * Drawing_FontHeightScalar;
-  *ascent = bounds.ascent;
-  *width = bounds.width;
+  if (context->recorder) context->recorder->metricInfo(c, gc);
+  Drawing_metricInfo(*context, c, gc, ascent, descent, width);
 }
 
 double DrawingDevice_strWidth(const char *str, const pGEcontext gc, pDevDesc dd) {
-  if (str == NULL) return 0;
-  if (strlen(str) == 0) return 0;
-
-  Drawing_TextBounds bounds;
+  if (dd == NULL) return 0;
   Drawing_Context *context = (Drawing_Context *)dd->deviceSpecific;
   if (context == NULL) return 0;
-  if (context->platform == nullptr) return 0;
-
-  context->platform->TextBoundingRect(gc, str, true, bounds);
 
-  return bounds.width;
+  if (context->recorder) context->recorder->strWidth(str, gc);
+  return Drawing_strWidth(*context, str, gc);
 }
 
 void DrawingDevice_raster(unsigned int *raster, int w, int h, double x, double y, double width, double height, double rot, Rboolean interpolate, const pGEcontext gc, pDevDesc dd) {
@@ -285,79 +673,187 @@ void DrawingDevice_rect(double x0, double y0, double x1, double y1, const pGEcon
   if (dd == NULL) return;
   Drawing_Context *context = (Drawing_Context *)dd->deviceSpecific;
   if (context == NULL) return;
-  if (context->platform == nullptr) return;
 
-  context->rect(context->id++, x0, y0, x1, y1, {*context->platform, gc});
+  if (context->recorder) context->recorder->rect(x0, y0, x1, y1, gc);
+  Drawing_rect(*context, x0, y0, x1, y1, gc);
 }
 
 void DrawingDevice_line(double x1, double y1, double x2, double y2, const pGEcontext gc, pDevDesc dd) {
   if (dd == NULL) return;
   Drawing_Context *context = (Drawing_Context *)dd->deviceSpecific;
   if (context == NULL) return;
-  if (context->platform == nullptr) return;
 
-  context->line(context->id++, x1, y1, x2, y2, {*context->platform, gc});
+  if (context->recorder) context->recorder->line(x1, y1, x2, y2, gc);
+  Drawing_line(*context, x1, y1, x2, y2, gc);
 }
 
 void DrawingDevice_circle(double x, double y, double r, const pGEcontext gc, pDevDesc dd) {
   if (dd == NULL) return;
   Drawing_Context *context = (Drawing_Context *)dd->deviceSpecific;
   if (context == NULL) return;
-  if (context->platform == nullptr) return;
 
-  context->circle(context->id++, x, y, r, {*context->platform, gc});
+  if (context->recorder) context->recorder->circle(x, y, r, gc);
+  Drawing_circle(*context, x, y, r, gc);
 }
 
 void DrawingDevice_polyline(int n, double *x, double *y, const pGEcontext gc, pDevDesc dd) {
-  if (n < 2) return;
   if (dd == NULL) return;
   Drawing_Context *context = (Drawing_Context *)dd->deviceSpecific;
   if (context == NULL) return;
-  if (context->platform == nullptr) return;
+
+  if (context->recorder) context->recorder->polyline(n, x, y, gc);
+  Drawing_polyline(*context, n, x, y, gc);
+}
+
+void DrawingDevice_polygon(int n, double *x, double *y, const pGEcontext gc, pDevDesc dd) {
+  if (dd == NULL) return;
+  Drawing_Context *context = (Drawing_Context *)dd->deviceSpecific;
+  if (context == NULL) return;
+
+  if (context->recorder) context->recorder->polygon(n, x, y, gc);
+  Drawing_polygon(*context, n, x, y, gc);
+}
+
+void DrawingDevice_text(double x, double y, const char *str, double rot, double hadj, const pGEcontext gc, pDevDesc dd) {
+  if (dd == NULL) return;
+  Drawing_Context *context = (Drawing_Context *)dd->deviceSpecific;
+  if (context == NULL) return;
+
+  if (context->recorder) context->recorder->text(x, y, str, rot, hadj, gc);
+  Drawing_text(*context, x, y, str, rot, hadj, gc);
+}
+
+// Device independent implementations of the callbacks, shared with Drawing_Replayer
+
+static void Drawing_TextBoundingRect(Drawing_Context &context, const pGEcontext gc, const std::string &str, Drawing_TextBounds &bounds) {
+  Drawing_ScopedTimer timer(context.stats, DRAWING_TIME_TEXT_METRICS);
+
+  if (context.platform->TextBoundingRect(gc, str, true, bounds))
+    context.stats.text_cache_hits++;
+  else
+    context.stats.text_cache_misses++;
+}
+
+void Drawing_newPage(Drawing_Context &context, double width, double height) {
+  context.initialise(width, height);
+}
+
+void Drawing_metricInfo(Drawing_Context &context, int c, const pGEcontext gc, double *ascent, double *descent, double *width) {
+  *ascent = *descent = *width = 0.0;
+  if (gc == NULL) return;
+  if (context.platform == nullptr) return;
+
+  context.stats.calls[DRAWING_CALL_METRICINFO]++;
+
+  // Because hasUTF8 is set to TRUE, when c < 0 it's a unicode point
+  if (c < 0) {
+    context.diagnostics.report(DRAWING_MSG_UNICODE_METRIC, [&](std::ostream &out) {
+      out << "metric info for unicode character " << -c;
+    });
+  }
+
+  Drawing_TextBounds bounds;
+  {
+    Drawing_ScopedTimer timer(context.stats, DRAWING_TIME_TEXT_METRICS);
+    if (context.platform->CharacterBoundingRect(gc, static_cast<uint32_t>(c < 0 ? -c : c), bounds))
+      context.stats.text_cache_hits++;
+    else
+      context.stats.text_cache_misses++;
+  }
+
+  *descent = -bounds.descent * Drawing_FontHeightScalar;
+  *ascent = bounds.ascent;
+  *width = bounds.width;
+}
+
+double Drawing_strWidth(Drawing_Context &context, const char *str, const pGEcontext gc) {
+  if (str == NULL) return 0;
+  if (strlen(str) == 0) return 0;
+  if (context.platform == nullptr) return 0;
+
+  Drawing_TextBounds bounds;
+
+  context.stats.calls[DRAWING_CALL_STRWIDTH]++;
+  Drawing_TextBoundingRect(context, gc, str, bounds);
+
+  return bounds.width;
+}
+
+void Drawing_rect(Drawing_Context &context, double x0, double y0, double x1, double y1, const pGEcontext gc) {
+  if (context.platform == nullptr) return;
+
+  context.stats.calls[DRAWING_CALL_RECT]++;
+  context.rect(context.id++, x0, y0, x1, y1, Drawing_Attributes(gc));
+}
+
+void Drawing_line(Drawing_Context &context, double x1, double y1, double x2, double y2, const pGEcontext gc) {
+  if (context.platform == nullptr) return;
+
+  context.stats.calls[DRAWING_CALL_LINE]++;
+  context.line(context.id++, x1, y1, x2, y2, Drawing_Attributes(gc));
+}
+
+void Drawing_circle(Drawing_Context &context, double x, double y, double r, const pGEcontext gc) {
+  if (context.platform == nullptr) return;
+
+  context.stats.calls[DRAWING_CALL_CIRCLE]++;
+  context.circle(context.id++, x, y, r, Drawing_Attributes(gc));
+}
+
+void Drawing_polyline(Drawing_Context &context, int n, const double *x, const double *y, const pGEcontext gc) {
+  if (n < 2) return;
+  if (context.platform == nullptr) return;
+
+  context.stats.calls[DRAWING_CALL_POLYLINE]++;
+  context.stats.points += n;
 
   std::vector<std::pair<double, double>> points;
+  points.reserve(n);
   for (int idx=0; idx<n; idx++)
     points.push_back({x[idx], y[idx]});
 
-  context->polyline(context->id++, points, {*context->platform, gc});
+  context.polyline(context.id++, std::move(points), Drawing_Attributes(gc));
 }
 
-void DrawingDevice_polygon(int n, double *x, double *y, const pGEcontext gc, pDevDesc dd) {
+void Drawing_polygon(Drawing_Context &context, int n, const double *x, const double *y, const pGEcontext gc) {
   if (n < 2) return;
-  if (dd == NULL) return;
-  Drawing_Context *context = (Drawing_Context *)dd->deviceSpecific;
-  if (context == NULL) return;
-  if (context->platform == nullptr) return;
+  if (context.platform == nullptr) return;
+
+  context.stats.calls[DRAWING_CALL_POLYGON]++;
+  context.stats.points += n;
 
   std::vector<std::pair<double, double>> points;
+  points.reserve(n);
   for (int idx=0; idx<n; idx++)
     points.push_back({x[idx], y[idx]});
 
-  context->polygon(context->id++, points, {*context->platform, gc});
+  context.polygon(context.id++, std::move(points), Drawing_Attributes(gc));
 }
 
-void DrawingDevice_text(double x, double y, const char *str, double rot, double hadj, const pGEcontext gc, pDevDesc dd) {
+void Drawing_text(Drawing_Context &context, double x, double y, const char *str, double rot, double hadj, const pGEcontext gc) {
   if (str == NULL) return;
   if (strlen(str) == 0) return;
   if (gc == NULL) return;
+  if (context.platform == nullptr) return;
+
+  context.stats.calls[DRAWING_CALL_TEXT]++;
+
   if ((gc->ps * gc->cex) < 0.5) {
     // Small text causes issues
-    Rcpp::Rcerr << "Text too small (pointsize: " << gc->ps * gc->cex << ")\n";
+    context.diagnostics.report(DRAWING_MSG_TEXT_TOO_SMALL, [&](std::ostream &out) {
+      out << "text too small (pointsize: " << gc->ps * gc->cex << ")";
+    });
     return;
   }
 
-  Drawing_Context *context = (Drawing_Context *)dd->deviceSpecific;
-  if (context == NULL) return;
-  if (context->platform == nullptr) return;
-
   Drawing_TextBounds bounds;
-  context->platform->TextBoundingRect(gc, str, true, bounds);
+  Drawing_TextBoundingRect(context, gc, str, bounds);
 
   if (bounds.empty()) return;
 
   bounds.height *= Drawing_FontHeightScalar;
 
-  Drawing_Attributes attributes(*context->platform, gc);
+  Drawing_Attributes attributes(*context.platform, gc);
   attributes.rotation = rot;
   attributes.hAdjustment = 0; // We'll incorporate adjustment into the bounding rect
 
@@ -376,10 +872,12 @@ void DrawingDevice_text(double x, double y, const char *str, double rot, double
 
   // Do we need any special handling for symbol (fontface == 5)?
   if (gc->fontface == 5) {
-    Rcpp::Rcout << "Asking for symbol. Char = " << str << "  [" << static_cast<int>(str[0]) << "]\n";
+    context.diagnostics.report(DRAWING_MSG_SYMBOL_TEXT, [&](std::ostream &out) {
+      out << "symbol font string '" << str << "' [" << static_cast<int>(str[0]) << "]";
+    });
   }
 
-  context->text(context->id++, tx, ty, tx + bounds.width, ty + bounds.height, str, hadj, attributes);
+  context.text(context.id++, tx, ty, tx + bounds.width, ty + bounds.height, str, hadj, attributes);
 }
 
 SEXP DrawingDevice_setPattern(SEXP pattern, pDevDesc dd) {
@@ -9,8 +9,15 @@
 #include <map>
 #include <variant>
 #include <memory>
+#include <chrono>
 #include "xml.h"
 #include "platform_specific.h"
+#include "object_store.h"
+#include "binary_io.h"
+#include "diagnostics.h"
+#include "stats.h"
+#include "recorder.h"
+#include "output_cache.h"
 
 struct emu {
   static std::string str(double v) {
@@ -70,7 +77,10 @@ struct Drawing_Attributes {
   bool italic;
   std::string font;
 
-  Drawing_Attributes() {};
+  Drawing_Attributes();
+  // Line and fill only, for geometry
+  Drawing_Attributes(const pGEcontext gc);
+  // Line, fill and font, for text
   Drawing_Attributes(const PlatformDeviceDriver &platform, const pGEcontext gc);
 };
 
@@ -82,12 +92,25 @@ struct Drawing_Alignment {
   std::string str_alignment() const;
 };
 
+// Tags identifying each shape in the spill log
+enum Drawing_GeomKind {
+  DRAWING_GEOM_GROUP = 1,
+  DRAWING_GEOM_RECT = 2,
+  DRAWING_GEOM_LINE = 3,
+  DRAWING_GEOM_CIRCLE = 4,
+  DRAWING_GEOM_POLYLINE = 5,
+  DRAWING_GEOM_POLYGON = 6,
+  DRAWING_GEOM_TEXT = 7
+};
+
 struct Drawing_Geom {
   int id;
   std::string name;
   virtual ~Drawing_Geom() {}
 
-  virtual std::vector<XMLNode> xml() const = 0;
+  virtual void xml(XMLWriter &out) const = 0;
+  virtual void encode(Drawing_BinaryWriter &out) const = 0;
+  virtual std::size_t footprint() const = 0; // approximate bytes held, including heap allocations
 };
 
 struct Drawing_Group : Drawing_Geom {
@@ -111,7 +134,9 @@ struct Drawing_Group : Drawing_Geom {
     this->interior_objects = interior_objects;
   }
 
-  virtual std::vector<XMLNode> xml() const = 0;
+  virtual void xml(XMLWriter &out) const = 0;
+  virtual void encode(Drawing_BinaryWriter &out) const;
+  virtual std::size_t footprint() const;
 };
 
 struct Drawing_Rect : Drawing_Geom {
@@ -124,9 +149,11 @@ struct Drawing_Rect : Drawing_Geom {
     this->y0 = y0;
     this->x1 = x1;
     this->y1 = y1;
-    this->attributes = attributes;
+    this->attributes = std::move(attributes);
   }
-  virtual std::vector<XMLNode> xml() const = 0;
+  virtual void xml(XMLWriter &out) const = 0;
+  virtual void encode(Drawing_BinaryWriter &out) const;
+  virtual std::size_t footprint() const;
 };
 
 struct Drawing_Line : Drawing_Geom {
@@ -139,9 +166,11 @@ struct Drawing_Line : Drawing_Geom {
     this->y1 = y1;
     this->x2 = x2;
     this->y2 = y2;
-    this->attributes = attributes;
+    this->attributes = std::move(attributes);
   }
-  virtual std::vector<XMLNode> xml() const = 0;
+  virtual void xml(XMLWriter &out) const = 0;
+  virtual void encode(Drawing_BinaryWriter &out) const;
+  virtual std::size_t footprint() const;
 };
 
 struct Drawing_Circle : Drawing_Geom {
@@ -154,33 +183,39 @@ struct Drawing_Circle : Drawing_Geom {
     this->x = x;
     this->y = y;
     this->radius = radius;
-    this->attributes = attributes;
+    this->attributes = std::move(attributes);
   }
-  virtual std::vector<XMLNode> xml() const = 0;
+  virtual void xml(XMLWriter &out) const = 0;
+  virtual void encode(Drawing_BinaryWriter &out) const;
+  virtual std::size_t footprint() const;
 };
 
 struct Drawing_Polyline : Drawing_Geom {
   std::vector<std::pair<double, double>> points;
   Drawing_Attributes attributes;
 
-  Drawing_Polyline(int id, std::vector<std::pair<double, double>> &points, Drawing_Attributes attributes) {
+  Drawing_Polyline(int id, std::vector<std::pair<double, double>> points, Drawing_Attributes attributes) {
     this->id = id;
-    this->points = points;
-    this->attributes = attributes;
+    this->points = std::move(points);
+    this->attributes = std::move(attributes);
   }
-  virtual std::vector<XMLNode> xml() const = 0;
+  virtual void xml(XMLWriter &out) const = 0;
+  virtual void encode(Drawing_BinaryWriter &out) const;
+  virtual std::size_t footprint() const;
 };
 
 struct Drawing_Polygon : Drawing_Geom {
   std::vector<std::pair<double, double>> points;
   Drawing_Attributes attributes;
 
-  Drawing_Polygon(int id, std::vector<std::pair<double, double>> &points, Drawing_Attributes attributes) {
+  Drawing_Polygon(int id, std::vector<std::pair<double, double>> points, Drawing_Attributes attributes) {
     this->id = id;
-    this->points = points;
-    this->attributes = attributes;
+    this->points = std::move(points);
+    this->attributes = std::move(attributes);
   }
-  virtual std::vector<XMLNode> xml() const = 0;
+  virtual void xml(XMLWriter &out) const = 0;
+  virtual void encode(Drawing_BinaryWriter &out) const;
+  virtual std::size_t footprint() const;
 };
 
 struct Drawing_Text : Drawing_Geom {
@@ -197,9 +232,30 @@ struct Drawing_Text : Drawing_Geom {
     this->y1 = y1;
     this->text = text;
     this->align = align;
-    this->attributes = attributes;
+    this->attributes = std::move(attributes);
   }
-  virtual std::vector<XMLNode> xml() const = 0;
+  virtual void xml(XMLWriter &out) const = 0;
+  virtual void encode(Drawing_BinaryWriter &out) const;
+  virtual std::size_t footprint() const;
+};
+
+// Tracks serialisation of a drawing on close. update() is called between chunks of
+// shapes; it checks for a user interrupt (throwing Rcpp::internal::InterruptedException)
+// and, once the export has run for a while, reports shapes and bytes written.
+struct Drawing_Progress {
+  std::size_t shapes_total;
+  std::size_t shapes_done;
+  std::size_t bytes_done;
+
+  Drawing_Progress(std::size_t shapes_total);
+  void update(std::size_t shapes, std::size_t bytes);
+  void finish();
+
+private:
+  std::chrono::steady_clock::time_point last_report;
+  bool reported;
+
+  void report();
 };
 
 struct Drawing_Context {
@@ -207,8 +263,13 @@ struct Drawing_Context {
   double canvasWidth;
   double canvasHeight;
 
-  std::vector<std::shared_ptr<Drawing_Geom>> objects;
+  Drawing_ObjectStore objects;
   std::unique_ptr<PlatformDeviceDriver> platform;
+  Drawing_Diagnostics diagnostics;
+  Drawing_Stats stats;
+  std::unique_ptr<Drawing_Recorder> recorder;
+  std::unique_ptr<Drawing_OutputCache> cache;
+  std::string cache_environment; // package version and font setup, part of the cache key
 
   Drawing_Context();
   virtual ~Drawing_Context() {}
@@ -218,13 +279,26 @@ struct Drawing_Context {
   virtual void rect(int id, double x0, double y0, double x1, double y1, Drawing_Attributes attributes) = 0;
   virtual void line(int id, double x1, double y1, double x2, double y2, Drawing_Attributes attributes) = 0;
   virtual void circle(int id, double x, double y, double radius, Drawing_Attributes attributes) = 0;
-  virtual void polyline(int id, std::vector<std::pair<double, double>> &points, Drawing_Attributes attributes) = 0;
-  virtual void polygon(int id, std::vector<std::pair<double, double>> &points, Drawing_Attributes attributes) = 0;
+  virtual void polyline(int id, std::vector<std::pair<double, double>> points, Drawing_Attributes attributes) = 0;
+  virtual void polygon(int id, std::vector<std::pair<double, double>> points, Drawing_Attributes attributes) = 0;
   virtual void text(int id, double x0, double y0, double x1, double y1, const std::string &text, Drawing_Alignment align, Drawing_Attributes attributes) = 0;
 
   virtual std::vector<std::pair<std::string, std::string>> container() = 0;
+
+  // Re-creates one shape written by Drawing_Geom::encode, through the methods above
+  void decode(Drawing_BinaryReader &in);
 };
 
+void Drawing_newPage(Drawing_Context &context, double width, double height);
+void Drawing_metricInfo(Drawing_Context &context, int c, const pGEcontext gc, double *ascent, double *descent, double *width);
+double Drawing_strWidth(Drawing_Context &context, const char *str, const pGEcontext gc);
+void Drawing_rect(Drawing_Context &context, double x0, double y0, double x1, double y1, const pGEcontext gc);
+void Drawing_line(Drawing_Context &context, double x1, double y1, double x2, double y2, const pGEcontext gc);
+void Drawing_circle(Drawing_Context &context, double x, double y, double r, const pGEcontext gc);
+void Drawing_polyline(Drawing_Context &context, int n, const double *x, const double *y, const pGEcontext gc);
+void Drawing_polygon(Drawing_Context &context, int n, const double *x, const double *y, const pGEcontext gc);
+void Drawing_text(Drawing_Context &context, double x, double y, const char *str, double rot, double hadj, const pGEcontext gc);
+
 void DrawingDevice_activate(pDevDesc dd);
 Rboolean DrawingDevice_newFrameConfirm(pDevDesc dd);
 void DrawingDevice_onExit(pDevDesc dd);
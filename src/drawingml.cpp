@@ -1,162 +1,175 @@
 #include <Rcpp.h>
 #include "drawingml.h"
 
-XMLNode ML_nvSpPr(int id, std::string name = "") {
-  return
-    XMLNode("a:nvSpPr") <<
-      XMLNode("a:cNvPr", {{"id",std::to_string(id)},{"name",name}}) <<
-      XMLNode("a:cNvSpPr");
+const std::size_t DrawingML_ChunkSize = 1000;
+
+void ML_nvSpPr(XMLWriter &out, int id, const std::string &name = "", bool textbox = false) {
+  out.startElement("a:nvSpPr");
+    out.startElement("a:cNvPr").attribute("id", std::to_string(id)).attribute("name", name).endElement();
+    out.startElement("a:cNvSpPr");
+    if (textbox) out.attribute("txBox", "1");
+    out.endElement();
+  out.endElement();
 }
 
-XMLNode ML_nvGrpSpPr(int id, std::string name = "") {
-  return
-    XMLNode("a:nvGrpSpPr") <<
-      XMLNode("a:cNvPr", {{"id",std::to_string(id)},{"name",name}}) <<
-      XMLNode("a:cNvGrpSpPr");
+void ML_nvGrpSpPr(XMLWriter &out, int id, const std::string &name = "") {
+  out.startElement("a:nvGrpSpPr");
+    out.startElement("a:cNvPr").attribute("id", std::to_string(id)).attribute("name", name).endElement();
+    out.startElement("a:cNvGrpSpPr").endElement();
+  out.endElement();
 }
 
-XMLNode ML_xfrm(double x, double y, double width, double height) {
-  return
-    XMLNode("a:xfrm") <<
-      XMLNode("a:off", {{"x",emu::str(x)},{"y",emu::str(y)}}) <<
-      XMLNode("a:ext", {{"cx",emu::str(width)},{"cy",emu::str(height)}});
+void ML_off_ext(XMLWriter &out, double x, double y, double width, double height) {
+  out.startElement("a:off").attribute("x", emu::str(x)).attribute("y", emu::str(y)).endElement();
+  out.startElement("a:ext").attribute("cx", emu::str(width)).attribute("cy", emu::str(height)).endElement();
 }
 
-XMLNode ML_xfrm_rect(double x1, double y1, double x2, double y2) {
-  std::vector<std::pair<std::string, std::string>> attr;
-  if (x2 < x1) attr.push_back({"flipH","1"});
-  if (y2 < y1) attr.push_back({"flipV","1"});
-
-  XMLNode node("a:xfrm", attr);
-  node << XMLNode("a:off", {{"x",emu::str(std::min(x1, x2))},{"y",emu::str(std::min(y1, y2))}});
-  node << XMLNode("a:ext", {{"cx",emu::str(std::abs(x2-x1))},{"cy",emu::str(std::abs(y2-y1))}});
-
-  return node;
+void ML_xfrm(XMLWriter &out, double x, double y, double width, double height) {
+  out.startElement("a:xfrm");
+    ML_off_ext(out, x, y, width, height);
+  out.endElement();
 }
 
-XMLNode ML_xfrm_rect(double x1, double y1, double x2, double y2, double rotate) {
-  std::vector<std::pair<std::string, std::string>> attr;
-  if (x2 < x1) attr.push_back({"flipH","1"});
-  if (y2 < y1) attr.push_back({"flipV","1"});
-  attr.push_back({"rot",std::to_string(static_cast<int>(-60000.0 * rotate))});
+void ML_xfrm_rect(XMLWriter &out, double x1, double y1, double x2, double y2) {
+  out.startElement("a:xfrm");
+  if (x2 < x1) out.attribute("flipH", "1");
+  if (y2 < y1) out.attribute("flipV", "1");
+    ML_off_ext(out, std::min(x1, x2), std::min(y1, y2), std::abs(x2-x1), std::abs(y2-y1));
+  out.endElement();
+}
 
-  XMLNode node("a:xfrm", attr);
-  node << XMLNode("a:off", {{"x",emu::str(std::min(x1, x2))},{"y",emu::str(std::min(y1, y2))}});
-  node << XMLNode("a:ext", {{"cx",emu::str(std::abs(x2-x1))},{"cy",emu::str(std::abs(y2-y1))}});
+void ML_xfrm_rect(XMLWriter &out, double x1, double y1, double x2, double y2, double rotate) {
+  out.startElement("a:xfrm");
+  if (x2 < x1) out.attribute("flipH", "1");
+  if (y2 < y1) out.attribute("flipV", "1");
+  out.attribute("rot", std::to_string(static_cast<int>(-60000.0 * rotate)));
+    ML_off_ext(out, std::min(x1, x2), std::min(y1, y2), std::abs(x2-x1), std::abs(y2-y1));
+  out.endElement();
+}
 
-  return node;
+void ML_xfrm(XMLWriter &out, double x, double y, double width, double height, double ch_x, double ch_y, double ch_width, double ch_height) {
+  out.startElement("a:xfrm");
+    ML_off_ext(out, x, y, width, height);
+    out.startElement("a:chOff").attribute("x", emu::str(ch_x)).attribute("y", emu::str(ch_y)).endElement();
+    out.startElement("a:chExt").attribute("cx", emu::str(ch_width)).attribute("cy", emu::str(ch_height)).endElement();
+  out.endElement();
 }
 
-XMLNode ML_xfrm(double x, double y, double width, double height, double ch_x, double ch_y, double ch_width, double ch_height) {
-  return
-    XMLNode("a:xfrm") <<
-      XMLNode("a:off", {{"x",emu::str(x)},{"y",emu::str(y)}}) <<
-      XMLNode("a:ext", {{"cx",emu::str(width)},{"cy",emu::str(height)}}) <<
-      XMLNode("a:chOff", {{"x",emu::str(ch_x)},{"y",emu::str(ch_y)}}) <<
-      XMLNode("a:chExt", {{"cx",emu::str(ch_width)},{"cy",emu::str(ch_height)}});
+void ML_prstGeom(XMLWriter &out, const std::string &preset) {
+  out.startElement("a:prstGeom").attribute("prst", preset).endElement();
 }
 
-XMLNode ML_solidFill(Drawing_Colour colour) {
-  return
-    XMLNode("a:solidFill") << (
-        XMLNode("a:srgbClr", {{"val",colour.str_rgb()}}) <<
-          XMLNode("a:alpha", {{"val",colour.str_alpha()}}));
+void ML_solidFill(XMLWriter &out, Drawing_Colour colour) {
+  out.startElement("a:solidFill");
+    out.startElement("a:srgbClr").attribute("val", colour.str_rgb());
+      out.startElement("a:alpha").attribute("val", colour.str_alpha()).endElement();
+    out.endElement();
+  out.endElement();
 }
 
-XMLNode ML_ln(double width, Drawing_LineType linetype, Drawing_Colour colour) {
+void ML_ln(XMLWriter &out, double width, Drawing_LineType linetype, Drawing_Colour colour) {
   if (linetype == Drawing_LineType::DRAWING_LINE_BLANK) {
     linetype = Drawing_LineType::DRAWING_LINE_SOLID;
     width = 0;
   }
 
-  return
-    XMLNode("a:ln", {{"w",emu::str(width)}}) <<
-      ML_solidFill(colour) <<
-        XMLNode("a:prstDash", {{"val",Drawing_LineType_str(linetype)}});
+  out.startElement("a:ln").attribute("w", emu::str(width));
+    ML_solidFill(out, colour);
+    out.startElement("a:prstDash").attribute("val", Drawing_LineType_str(linetype)).endElement();
+  out.endElement();
+}
+
+void ML_ln(XMLWriter &out, const Drawing_Attributes &attributes) {
+  ML_ln(out, attributes.lineWidth, attributes.lineType, attributes.lineColour);
 }
 
-XMLNode ML_ln(Drawing_Attributes attributes) {
-  return ML_ln(attributes.lineWidth, attributes.lineType, attributes.lineColour);
+void ML_pt(XMLWriter &out, double x, double y) {
+  out.startElement("a:pt").attribute("x", emu::str(x)).attribute("y", emu::str(y)).endElement();
 }
 
-XMLNode ML_pt(double x, double y) {
-  return XMLNode("a:pt", {{"x",emu::str(x)},{"y",emu::str(y)}});
+// Freeform path through points, relative to their bounding box x0, y0, x1, y1
+void ML_custGeom(XMLWriter &out, const std::vector<std::pair<double, double>> &points, bool closed,
+                 double x0, double y0, double x1, double y1) {
+  out.startElement("a:custGeom");
+    out.startElement("a:avLst").endElement();
+    out.startElement("a:gdLst").endElement();
+    out.startElement("a:ahLst").endElement();
+    out.startElement("a:cxnLst").endElement();
+    out.startElement("a:pathLst");
+      out.startElement("a:path").attribute("w", emu::str(x1-x0)).attribute("h", emu::str(y1-y0));
+        out.startElement("a:moveTo");
+          ML_pt(out, points[0].first-x0, points[0].second-y0);
+        out.endElement();
+
+        for (std::size_t idx=1; idx<points.size(); idx++) {
+          out.startElement("a:lnTo");
+            ML_pt(out, points[idx].first-x0, points[idx].second-y0);
+          out.endElement();
+        }
+
+        if (closed) out.startElement("a:close").endElement();
+      out.endElement();
+    out.endElement();
+  out.endElement();
 }
 
-std::vector<XMLNode> DrawingML_Group::xml() const {
+void DrawingML_Group::xml(XMLWriter &out) const {
   if (interior_objects.size() == 0) {
-    return {
-      ML_nvGrpSpPr(id, name),
-      XMLNode("a:grpSpPr") <<
-        ML_xfrm(0, 0, width, height, 0, 0, width, height)
-    };
+    ML_nvGrpSpPr(out, id, name);
+    out.startElement("a:grpSpPr");
+      ML_xfrm(out, 0, 0, width, height, 0, 0, width, height);
+    out.endElement();
+    return;
   }
 
-  XMLNode node =
-    XMLNode("a:grpSp") <<
-      ML_nvGrpSpPr(id, name) <<
-        (XMLNode("a:grpSpPr") << ML_xfrm(0, 0, width, height, 0, 0, width, height));
-
-  std::vector<XMLNode> nodes;
-
-  for (auto &object : interior_objects)
-    for (auto &node : object->xml())
-      nodes.push_back(node);
+  out.startElement("a:grpSp");
+    ML_nvGrpSpPr(out, id, name);
+    out.startElement("a:grpSpPr");
+      ML_xfrm(out, 0, 0, width, height, 0, 0, width, height);
+    out.endElement();
 
-  node = node << nodes;
-
-  return {node};
+    for (auto &object : interior_objects)
+      object->xml(out);
+  out.endElement();
 }
 
-std::vector<XMLNode> DrawingML_Rect::xml() const {
-  return {
-    XMLNode("a:sp") <<
-      XMLNodes({
-        ML_nvSpPr(id, name),
-        XMLNode("a:spPr") <<
-          XMLNodes({
-            ML_xfrm_rect(x0, y0, x1, y1),
-            XMLNode("a:prstGeom", {{"prst","rect"}}),
-            ML_solidFill(attributes.fillColour),
-            ML_ln(attributes)
-          })
-      })
-  };
+void DrawingML_Rect::xml(XMLWriter &out) const {
+  out.startElement("a:sp");
+    ML_nvSpPr(out, id, name);
+    out.startElement("a:spPr");
+      ML_xfrm_rect(out, x0, y0, x1, y1);
+      ML_prstGeom(out, "rect");
+      ML_solidFill(out, attributes.fillColour);
+      ML_ln(out, attributes);
+    out.endElement();
+  out.endElement();
 }
 
-std::vector<XMLNode> DrawingML_Line::xml() const {
-  return {
-    XMLNode("a:sp") <<
-      XMLNodes({
-        ML_nvSpPr(id, name),
-        XMLNode("a:spPr") <<
-          XMLNodes({
-            ML_xfrm_rect(x1, y1, x2, y2),
-            XMLNode("a:prstGeom", {{"prst","line"}}),
-            ML_ln(attributes)
-          })
-      })
-  };
+void DrawingML_Line::xml(XMLWriter &out) const {
+  out.startElement("a:sp");
+    ML_nvSpPr(out, id, name);
+    out.startElement("a:spPr");
+      ML_xfrm_rect(out, x1, y1, x2, y2);
+      ML_prstGeom(out, "line");
+      ML_ln(out, attributes);
+    out.endElement();
+  out.endElement();
 }
 
-std::vector<XMLNode> DrawingML_Circle::xml() const {
-  return {
-    XMLNode("a:sp") <<
-      XMLNodes({
-        ML_nvSpPr(id, name),
-        XMLNode("a:spPr") <<
-          XMLNodes({
-            ML_xfrm(x - radius, y - radius, radius * 2, radius * 2),
-            XMLNode("a:prstGeom", {{"prst","ellipse"}}),
-            ML_solidFill(attributes.fillColour),
-            ML_ln(attributes)
-          })
-      })
-  };
+void DrawingML_Circle::xml(XMLWriter &out) const {
+  out.startElement("a:sp");
+    ML_nvSpPr(out, id, name);
+    out.startElement("a:spPr");
+      ML_xfrm(out, x - radius, y - radius, radius * 2, radius * 2);
+      ML_prstGeom(out, "ellipse");
+      ML_solidFill(out, attributes.fillColour);
+      ML_ln(out, attributes);
+    out.endElement();
+  out.endElement();
 }
 
-std::vector<XMLNode> DrawingML_Polyline::xml() const {
-  if (points.size() < 2) return {};
+void DrawingML_Polyline::xml(XMLWriter &out) const {
+  if (points.size() < 2) return;
 
   auto minmax_x = std::minmax_element(points.begin(), points.end(), [](auto const& lhs, auto const& rhs){return lhs.first < rhs.first;});
   double x0 = minmax_x.first->first;
@@ -166,30 +179,18 @@ std::vector<XMLNode> DrawingML_Polyline::xml() const {
   double y0 = minmax_y.first->second;
   double y1 = minmax_y.second->second;
 
-  XMLNode pathnode =
-    XMLNode("a:path", {{"w",emu::str(x1-x0)},{"h",emu::str(y1-y0)}}) <<
-      (XMLNode("a:moveTo") << ML_pt(points[0].first-x0, points[0].second-y0));
-
-  for (std::size_t idx=1; idx<points.size(); idx++)
-    pathnode = pathnode << (XMLNode("a:lnTo") << ML_pt(points[idx].first-x0, points[idx].second-y0));
-
-  return {
-    XMLNode("a:sp") <<
-      XMLNodes({
-        ML_nvSpPr(id, name),
-        XMLNode("a:spPr") <<
-          XMLNodes({
-            ML_xfrm(x0, y0, x1-x0, y1-y0),
-            XMLNode("a:custGeom") << XMLNode("a:avLst") << XMLNode("a:gdLst") <<
-            XMLNode("a:ahLst") << XMLNode("a:cxnLst") << (XMLNode("a:pathLst") << pathnode),
-            ML_ln(attributes)
-          })
-      })
-  };
+  out.startElement("a:sp");
+    ML_nvSpPr(out, id, name);
+    out.startElement("a:spPr");
+      ML_xfrm(out, x0, y0, x1-x0, y1-y0);
+      ML_custGeom(out, points, false, x0, y0, x1, y1);
+      ML_ln(out, attributes);
+    out.endElement();
+  out.endElement();
 }
 
-std::vector<XMLNode> DrawingML_Polygon::xml() const {
-  if (points.size() < 2) return {};
+void DrawingML_Polygon::xml(XMLWriter &out) const {
+  if (points.size() < 2) return;
 
   auto minmax_x = std::minmax_element(points.begin(), points.end(), [](auto const& lhs, auto const& rhs){return lhs.first < rhs.first;});
   double x0 = minmax_x.first->first;
@@ -199,75 +200,48 @@ std::vector<XMLNode> DrawingML_Polygon::xml() const {
   double y0 = minmax_y.first->second;
   double y1 = minmax_y.second->second;
 
-  XMLNode pathnode =
-    XMLNode("a:path", {{"w",emu::str(x1-x0)},{"h",emu::str(y1-y0)}}) <<
-      (XMLNode("a:moveTo") << ML_pt(points[0].first-x0, points[0].second-y0));
-
-  for (std::size_t idx=1; idx<points.size(); idx++)
-    pathnode = pathnode << (XMLNode("a:lnTo") << ML_pt(points[idx].first-x0, points[idx].second-y0));
-
-  pathnode = pathnode << XMLNode("a:close");
-
-  return {
-      XMLNode("a:sp") <<
-        XMLNodes({
-          ML_nvSpPr(id, name),
-          XMLNode("a:spPr") <<
-            XMLNodes({
-              ML_xfrm(x0, y0, x1-x0, y1-y0),
-              XMLNode("a:custGeom") << XMLNode("a:avLst") << XMLNode("a:gdLst") <<
-              XMLNode("a:ahLst") << XMLNode("a:cxnLst") << (XMLNode("a:pathLst") << pathnode),
-              ML_solidFill(attributes.fillColour),
-              ML_ln(attributes)
-            })
-        })
-    };
+  out.startElement("a:sp");
+    ML_nvSpPr(out, id, name);
+    out.startElement("a:spPr");
+      ML_xfrm(out, x0, y0, x1-x0, y1-y0);
+      ML_custGeom(out, points, true, x0, y0, x1, y1);
+      ML_solidFill(out, attributes.fillColour);
+      ML_ln(out, attributes);
+    out.endElement();
+  out.endElement();
 }
 
-std::vector<XMLNode> DrawingML_Text::xml() const {
-  return {
-    XMLNode("a:sp") <<
-      XMLNodes({
-        (
-          XMLNode("a:nvSpPr") <<
-            XMLNode("a:cNvPr", {{"id",std::to_string(id)},{"name",name}}) <<
-            XMLNode("a:cNvSpPr", {{"txBox","1"}})
-        ),
-        XMLNode("a:spPr") <<
-          XMLNodes({
-            ML_xfrm_rect(x0, y0, x1, y1, attributes.rotation),
-            XMLNode("a:prstGeom", {{"prst","rect"}}),
-            XMLNode("a:noFill")
-          }),
-        XMLNode("a:txSp") <<
-          XMLNodes({
-            XMLNode("a:txBody") <<
-              XMLNodes({
-                XMLNode("a:bodyPr", {{"wrap","none"},{"lIns","0"},{"tIns","0"},
-                                     {"rIns","0"},{"bIns","0"},{"anchor","b"},
-                                     {"anchorCtr","1"}}) <<
-                  XMLNode("a:spAutoFit"),
-                XMLNode("a:p") <<
-                  XMLNodes({
-                    XMLNode("a:pPr", {{"algn",align.str_alignment()}}),
-                    XMLNode("a:r") <<
-                      XMLNodes({
-                        XMLNode("a:rPr", {{"sz",std::to_string(static_cast<int>(100.0 * attributes.pointSize))},
-                                          {"b",(attributes.bold ? "1" : "0")},{"i",(attributes.italic ? "1":"0")},
-                                          {"dirty","0"}}) <<
-                          XMLNodes({
-                            ML_solidFill(attributes.lineColour), // use colour, not fill colour for text
-                            XMLNode("a:latin", {{"typeface",attributes.font}}),
-                            XMLNode("a:cs", {{"typeface",attributes.font}})
-                          }),
-                        XMLNode("a:t", text)
-                      }) // a:r
-                  }) // a:p
-              }),  // a:txBody
-            XMLNode("a:useSpRect")
-          }) // a:txSp
-      }) // a:sp
-    };
+void DrawingML_Text::xml(XMLWriter &out) const {
+  out.startElement("a:sp");
+    ML_nvSpPr(out, id, name, true);
+    out.startElement("a:spPr");
+      ML_xfrm_rect(out, x0, y0, x1, y1, attributes.rotation);
+      ML_prstGeom(out, "rect");
+      out.startElement("a:noFill").endElement();
+    out.endElement();
+    out.startElement("a:txSp");
+      out.startElement("a:txBody");
+        out.startElement("a:bodyPr").attribute("wrap", "none").attribute("lIns", "0").attribute("tIns", "0")
+          .attribute("rIns", "0").attribute("bIns", "0").attribute("anchor", "b").attribute("anchorCtr", "1");
+          out.startElement("a:spAutoFit").endElement();
+        out.endElement();
+        out.startElement("a:p");
+          out.startElement("a:pPr").attribute("algn", align.str_alignment()).endElement();
+          out.startElement("a:r");
+            out.startElement("a:rPr").attribute("sz", std::to_string(static_cast<int>(100.0 * attributes.pointSize)))
+              .attribute("b", attributes.bold ? "1" : "0").attribute("i", attributes.italic ? "1" : "0")
+              .attribute("dirty", "0");
+              ML_solidFill(out, attributes.lineColour); // use colour, not fill colour for text
+              out.startElement("a:latin").attribute("typeface", attributes.font).endElement();
+              out.startElement("a:cs").attribute("typeface", attributes.font).endElement();
+            out.endElement(); // a:rPr
+            out.startElement("a:t").text(text).endElement();
+          out.endElement(); // a:r
+        out.endElement(); // a:p
+      out.endElement(); // a:txBody
+      out.startElement("a:useSpRect").endElement();
+    out.endElement(); // a:txSp
+  out.endElement(); // a:sp
 }
 
 void DrawingML_Context::initialise(double width, double height) {
@@ -278,18 +252,13 @@ void DrawingML_Context::initialise(double width, double height) {
 }
 
 std::vector<std::pair<std::string, std::string>> DrawingML_Context::container() {
-  std::vector<std::shared_ptr<Drawing_Geom>> canvas;
-
-  canvas.emplace_back(std::make_shared<DrawingML_Group>(0, canvasWidth, canvasHeight, "Canvas"));
-  canvas.emplace_back(std::make_shared<DrawingML_Group>(1, 0, 0, canvasWidth, canvasHeight, "MainGroup", objects));
-
   return
     {
       {"[Content_Types].xml", MLContainer_Content_Types()},
       {"_rels/.rels", MLContainer_Relationships()},
       {"clipboard/drawings/_rels/drawing1.xml.rels", MLContainer_DrawingRelationships()},
       {"clipboard/theme/theme1.xml", MLContainer_Theme1()},
-      {"clipboard/drawings/drawing1.xml", MLContainer_Drawing(canvas)}
+      {"clipboard/drawings/drawing1.xml", MLContainer_Drawing(objects)}
     };
 }
 
@@ -340,28 +309,47 @@ std::string DrawingML_Context::MLContainer_DrawingRelationships() {
   return doc.write();
 }
 
-std::string DrawingML_Context::MLContainer_Drawing(const std::vector<std::shared_ptr<Drawing_Geom>>& objects) {
-  XML doc;
+// Objects are placed in a "MainGroup" within the locked canvas. Shapes are written
+// straight into the output a chunk at a time, so no XML tree is built and the user can
+// interrupt between chunks.
+std::string DrawingML_Context::MLContainer_Drawing(Drawing_ObjectStore& objects) {
+  std::string out = XML().declaration();
+  XMLWriter xml(out);
 
-  std::vector<XMLNode> nodes;
+  xml.startElement("a:graphic").attribute("xmlns:a", "http://schemas.openxmlformats.org/drawingml/2006/main");
+  xml.startElement("a:graphicData").attribute("uri", "http://schemas.openxmlformats.org/drawingml/2006/lockedCanvas");
+  xml.startElement("lc:lockedCanvas").attribute("xmlns:lc", "http://schemas.openxmlformats.org/drawingml/2006/lockedCanvas");
 
-  for (auto &object : objects)
-    for (auto &node : object->xml())
-      nodes.push_back(node);
+  DrawingML_Group(0, canvasWidth, canvasHeight, "Canvas").xml(xml);
 
-  doc.setRoot(
-    XMLNode("a:graphic", {{"xmlns:a", "http://schemas.openxmlformats.org/drawingml/2006/main"}}) <<
-            (
-                XMLNode("a:graphicData", {{"uri", "http://schemas.openxmlformats.org/drawingml/2006/lockedCanvas"}}) <<
-                  (
-                      XMLNode("lc:lockedCanvas", {{"xmlns:lc","http://schemas.openxmlformats.org/drawingml/2006/lockedCanvas"}}) <<
-                        nodes
-                  )
-            )
-  );
+  Drawing_Progress progress(objects.size());
 
-  return doc.write();
-}
+  if (objects.size() > 0) {
+    xml.startElement("a:grpSp");
+    ML_nvGrpSpPr(xml, 1, "MainGroup");
+    xml.startElement("a:grpSpPr");
+    ML_xfrm(xml, 0, 0, canvasWidth, canvasHeight, 0, 0, canvasWidth, canvasHeight);
+    xml.endElement();
 
+    std::size_t shapes_done = 0;
+    objects.forEachChunk(DrawingML_ChunkSize, [&](const std::vector<std::shared_ptr<Drawing_Geom>>& chunk) {
+      for (auto &object : chunk)
+        object->xml(xml);
 
+      shapes_done += chunk.size();
+      progress.update(shapes_done, out.size());
+    });
+
+    xml.endElement(); // a:grpSp
+  } else {
+    DrawingML_Group(1, canvasWidth, canvasHeight, "MainGroup").xml(xml);
+  }
 
+  xml.endElement(); // lc:lockedCanvas
+  xml.endElement(); // a:graphicData
+  xml.endElement(); // a:graphic
+
+  progress.finish();
+
+  return out;
+}
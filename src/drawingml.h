@@ -9,49 +9,49 @@ struct DrawingML_Group : Drawing_Group {
     DrawingML_Group(int id, double x, double y, double width, double height, std::string name, std::vector<std::shared_ptr<Drawing_Geom>> &interior_objects) :
         Drawing_Group(id, x, y, width, height, name, interior_objects) {}
 
-    virtual std::vector<XMLNode> xml() const;
+    virtual void xml(XMLWriter &out) const;
 };
 
 struct DrawingML_Rect : Drawing_Rect {
     DrawingML_Rect(int id, double x0, double y0, double x1, double y1, Drawing_Attributes attributes) :
-        Drawing_Rect(id, x0, y0, x1, y1, attributes) {}
+        Drawing_Rect(id, x0, y0, x1, y1, std::move(attributes)) {}
 
-    virtual std::vector<XMLNode> xml() const;
+    virtual void xml(XMLWriter &out) const;
 };
 
 struct DrawingML_Line : Drawing_Line {
     DrawingML_Line(int id, double x1, double y1, double x2, double y2, Drawing_Attributes attributes) :
-        Drawing_Line(id, x1, y1, x2, y2, attributes) {}
+        Drawing_Line(id, x1, y1, x2, y2, std::move(attributes)) {}
 
-    virtual std::vector<XMLNode> xml() const;
+    virtual void xml(XMLWriter &out) const;
 };
 
 struct DrawingML_Circle : Drawing_Circle {
     DrawingML_Circle(int id, double x, double y, double radius, Drawing_Attributes attributes) :
-        Drawing_Circle(id, x, y, radius, attributes) {}
+        Drawing_Circle(id, x, y, radius, std::move(attributes)) {}
 
-    virtual std::vector<XMLNode> xml() const;
+    virtual void xml(XMLWriter &out) const;
 };
 
 struct DrawingML_Polyline : Drawing_Polyline {
-    DrawingML_Polyline(int id, std::vector<std::pair<double, double>> &points, Drawing_Attributes attributes) :
-        Drawing_Polyline(id, points, attributes) {}
+    DrawingML_Polyline(int id, std::vector<std::pair<double, double>> points, Drawing_Attributes attributes) :
+        Drawing_Polyline(id, std::move(points), std::move(attributes)) {}
 
-    virtual std::vector<XMLNode> xml() const;
+    virtual void xml(XMLWriter &out) const;
 };
 
 struct DrawingML_Polygon : Drawing_Polygon {
-    DrawingML_Polygon(int id, std::vector<std::pair<double, double>> &points, Drawing_Attributes attributes) :
-        Drawing_Polygon(id, points, attributes) {}
+    DrawingML_Polygon(int id, std::vector<std::pair<double, double>> points, Drawing_Attributes attributes) :
+        Drawing_Polygon(id, std::move(points), std::move(attributes)) {}
 
-    virtual std::vector<XMLNode> xml() const;
+    virtual void xml(XMLWriter &out) const;
 };
 
 struct DrawingML_Text : Drawing_Text {
     DrawingML_Text(int id, double x0, double y0, double x1, double y1, const std::string &text, Drawing_Alignment align, Drawing_Attributes attributes) :
-        Drawing_Text(id, x0, y0, x1, y1, text, align, attributes) {}
+        Drawing_Text(id, x0, y0, x1, y1, text, align, std::move(attributes)) {}
 
-    virtual std::vector<XMLNode> xml() const;
+    virtual void xml(XMLWriter &out) const;
 };
 
 struct DrawingML_Context : Drawing_Context {
@@ -66,22 +66,22 @@ struct DrawingML_Context : Drawing_Context {
         objects.emplace_back(std::make_shared<DrawingML_Group>(id, x, y, width, height, name, interior_objects));
     }
     virtual void rect(int id, double x0, double y0, double x1, double y1, Drawing_Attributes attributes) {
-        objects.emplace_back(std::make_shared<DrawingML_Rect>(id, x0, y0, x1, y1, attributes));
+        objects.emplace_back(std::make_shared<DrawingML_Rect>(id, x0, y0, x1, y1, std::move(attributes)));
     }
     virtual void line(int id, double x1, double y1, double x2, double y2, Drawing_Attributes attributes) {
-        objects.emplace_back(std::make_shared<DrawingML_Line>(id, x1, y1, x2, y2, attributes));
+        objects.emplace_back(std::make_shared<DrawingML_Line>(id, x1, y1, x2, y2, std::move(attributes)));
     }
     virtual void circle(int id, double x, double y, double radius, Drawing_Attributes attributes) {
-        objects.emplace_back(std::make_shared<DrawingML_Circle>(id, x, y, radius, attributes));
+        objects.emplace_back(std::make_shared<DrawingML_Circle>(id, x, y, radius, std::move(attributes)));
     }
-    virtual void polyline(int id, std::vector<std::pair<double, double>> &points, Drawing_Attributes attributes) {
-        objects.emplace_back(std::make_shared<DrawingML_Polyline>(id, points, attributes));
+    virtual void polyline(int id, std::vector<std::pair<double, double>> points, Drawing_Attributes attributes) {
+        objects.emplace_back(std::make_shared<DrawingML_Polyline>(id, std::move(points), std::move(attributes)));
     }
-    virtual void polygon(int id, std::vector<std::pair<double, double>> &points, Drawing_Attributes attributes) {
-        objects.emplace_back(std::make_shared<DrawingML_Polyline>(id, points, attributes));
+    virtual void polygon(int id, std::vector<std::pair<double, double>> points, Drawing_Attributes attributes) {
+        objects.emplace_back(std::make_shared<DrawingML_Polyline>(id, std::move(points), std::move(attributes)));
     }
     virtual void text(int id, double x0, double y0, double x1, double y1, const std::string &text, Drawing_Alignment align, Drawing_Attributes attributes) {
-        objects.emplace_back(std::make_shared<DrawingML_Text>(id, x0, y0, x1, y1, text, align, attributes));
+        objects.emplace_back(std::make_shared<DrawingML_Text>(id, x0, y0, x1, y1, text, align, std::move(attributes)));
     }
 
     virtual std::vector<std::pair<std::string, std::string>> container();
@@ -90,7 +90,7 @@ struct DrawingML_Context : Drawing_Context {
     std::string MLContainer_Theme1(bool full_theme = false);
     std::string MLContainer_Relationships();
     std::string MLContainer_DrawingRelationships();
-    std::string MLContainer_Drawing(const std::vector<std::shared_ptr<Drawing_Geom>> &objects);
+    std::string MLContainer_Drawing(Drawing_ObjectStore &objects);
 };
 
 
@@ -22,6 +22,10 @@ std::unique_ptr<PlatformDeviceDriver> NewPlatformDeviceDriver() {
   return std::make_unique<MacOSDeviceDriver>();
 }
 
+std::unique_ptr<PlatformDeviceDriver> NewPlatformTextMeasurer() {
+  return nullptr;
+}
+
 MacOSDeviceDriver::MacOSDeviceDriver() {
 
 }
@@ -0,0 +1,81 @@
+#include "mapped_file.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+MappedFile::MappedFile(const std::string &path) {
+  bytes = nullptr;
+  length = 0;
+  mapping = NULL;
+
+  file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                     NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    throw std::runtime_error("Unable to open '" + path + "' for mapping");
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size)) {
+    CloseHandle(file);
+    throw std::runtime_error("Unable to size '" + path + "' for mapping");
+  }
+
+  length = static_cast<std::size_t>(file_size.QuadPart);
+  if (length == 0) return; // nothing to map
+
+  mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping != NULL)
+    bytes = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+
+  if (bytes == nullptr) {
+    if (mapping != NULL) CloseHandle(mapping);
+    CloseHandle(file);
+    throw std::runtime_error("Unable to map '" + path + "'");
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (bytes) UnmapViewOfFile(bytes);
+  if (mapping != NULL) CloseHandle(mapping);
+  if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+}
+
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &path) {
+  bytes = nullptr;
+  length = 0;
+
+  fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Unable to open '" + path + "' for mapping");
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::runtime_error("Unable to size '" + path + "' for mapping");
+  }
+
+  length = static_cast<std::size_t>(st.st_size);
+  if (length == 0) return; // nothing to map
+
+  void *address = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+  if (address == MAP_FAILED) {
+    close(fd);
+    throw std::runtime_error("Unable to map '" + path + "'");
+  }
+
+  bytes = static_cast<const uint8_t *>(address);
+}
+
+MappedFile::~MappedFile() {
+  if (bytes) munmap(const_cast<uint8_t *>(bytes), length);
+  if (fd >= 0) close(fd);
+}
+
+#endif
@@ -0,0 +1,25 @@
+// Read-only memory mapping of a whole file
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+class MappedFile {
+  const uint8_t *bytes;
+  std::size_t length;
+#ifdef _WIN32
+  void *file;
+  void *mapping;
+#else
+  int fd;
+#endif
+
+public:
+  MappedFile(const std::string &path);
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const uint8_t *data() const { return bytes; }
+  std::size_t size() const { return length; }
+};
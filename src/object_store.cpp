@@ -0,0 +1,143 @@
+#include <Rcpp.h>
+#include "drawing_device.h"
+#include "object_store.h"
+#include "mapped_file.h"
+#include "binary_io.h"
+#include <algorithm>
+
+// Encoded shapes are written to the spill log in blocks of about this size
+const std::size_t Drawing_SpillBlockSize = 1 << 20;
+// shared_ptr slot in the vector plus the control block allocated by make_shared
+const std::size_t Drawing_ObjectOverhead = sizeof(std::shared_ptr<Drawing_Geom>) + 16;
+
+Drawing_ObjectStore::Drawing_ObjectStore(Drawing_Context &context) : context(context) {
+  memory_used = 0;
+  memory_budget = 0;
+  spill = nullptr;
+  spilled = 0;
+  restoring = false;
+}
+
+Drawing_ObjectStore::~Drawing_ObjectStore() {
+  closeSpill();
+}
+
+void Drawing_ObjectStore::setBudget(std::size_t bytes, const std::string &spill_path) {
+  memory_budget = bytes;
+  this->spill_path = spill_path;
+}
+
+void Drawing_ObjectStore::emplace_back(std::shared_ptr<Drawing_Geom> object) {
+  if (restoring) {
+    objects.emplace_back(std::move(object));
+    return;
+  }
+
+  memory_used += object->footprint() + Drawing_ObjectOverhead;
+  objects.emplace_back(std::move(object));
+
+  if ((memory_budget > 0) && (memory_used > memory_budget) && !spill_path.empty())
+    spillObjects();
+}
+
+std::vector<std::shared_ptr<Drawing_Geom>> Drawing_ObjectStore::takeLast(std::size_t n) {
+  if (n > objects.size())
+    throw std::runtime_error("Spill log refers to more objects than were restored");
+
+  std::vector<std::shared_ptr<Drawing_Geom>> taken(objects.end() - n, objects.end());
+  objects.resize(objects.size() - n);
+
+  return taken;
+}
+
+void Drawing_ObjectStore::clear() {
+  objects.clear();
+  memory_used = 0;
+  closeSpill();
+}
+
+void Drawing_ObjectStore::spillObjects() {
+  if (spill == nullptr) {
+    spill = std::fopen(spill_path.c_str(), "wb");
+    if (spill == nullptr)
+      throw std::runtime_error("Unable to create spill file '" + spill_path + "'");
+  }
+
+  std::string buffer;
+  Drawing_BinaryWriter out(buffer);
+
+  for (const auto &object : objects) {
+    object->encode(out);
+
+    if (buffer.size() >= Drawing_SpillBlockSize) {
+      if (std::fwrite(buffer.data(), 1, buffer.size(), spill) != buffer.size())
+        throw std::runtime_error("Unable to write to spill file '" + spill_path + "'");
+      buffer.clear();
+    }
+  }
+
+  if (std::fwrite(buffer.data(), 1, buffer.size(), spill) != buffer.size())
+    throw std::runtime_error("Unable to write to spill file '" + spill_path + "'");
+
+  spilled += objects.size();
+  objects.clear();
+  objects.shrink_to_fit();
+  memory_used = 0;
+}
+
+void Drawing_ObjectStore::closeSpill() {
+  if (spill) {
+    std::fclose(spill);
+    std::remove(spill_path.c_str());
+    spill = nullptr;
+  }
+
+  spilled = 0;
+}
+
+void Drawing_ObjectStore::forEachChunk(std::size_t chunk_size, const ChunkFunction &fn) {
+  // Shapes still in memory were recorded after everything in the spill log
+  std::vector<std::shared_ptr<Drawing_Geom>> recent;
+  recent.swap(objects);
+  restoring = true;
+
+  try {
+    if (spill) {
+      if (std::fflush(spill) != 0)
+        throw std::runtime_error("Unable to flush spill file '" + spill_path + "'");
+
+      MappedFile log(spill_path);
+      Drawing_BinaryReader in(log.data(), log.size());
+
+      while (!in.eof()) {
+        // Decoding calls back into the context, which adds the shape to this store
+        context.decode(in);
+
+        if (objects.size() >= chunk_size) {
+          fn(objects);
+          objects.clear();
+        }
+      }
+
+      if (!objects.empty()) {
+        fn(objects);
+        objects.clear();
+      }
+    }
+
+    std::vector<std::shared_ptr<Drawing_Geom>> chunk;
+    for (std::size_t idx = 0; idx < recent.size(); idx += chunk_size) {
+      chunk.assign(recent.begin() + idx, recent.begin() + std::min(idx + chunk_size, recent.size()));
+      fn(chunk);
+    }
+  }
+
+  catch (...) {
+    objects.swap(recent);
+    restoring = false;
+    throw;
+  }
+
+  objects.swap(recent);
+  restoring = false;
+}
@@ -0,0 +1,51 @@
+// Storage for the shapes recorded by a device. Once the estimated memory held by
+// recorded shapes exceeds the budget, they are encoded and appended to a spill
+// log on disk. The log is memory-mapped back and decoded chunk by chunk when the
+// drawing is serialised. Only the shape objects are bounded by the budget: the
+// serialised drawing XML and the zip archive handed to the clipboard are still
+// built in memory.
+#pragma once
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+struct Drawing_Geom;
+struct Drawing_Context;
+
+class Drawing_ObjectStore {
+  Drawing_Context &context;
+  std::vector<std::shared_ptr<Drawing_Geom>> objects;
+  std::size_t memory_used;
+  std::size_t memory_budget;
+  std::string spill_path;
+  std::FILE *spill;
+  std::size_t spilled;
+  bool restoring;
+
+  void spillObjects();
+  void closeSpill();
+
+public:
+  typedef std::function<void(const std::vector<std::shared_ptr<Drawing_Geom>>&)> ChunkFunction;
+
+  Drawing_ObjectStore(Drawing_Context &context);
+  ~Drawing_ObjectStore();
+  Drawing_ObjectStore(const Drawing_ObjectStore &) = delete;
+  Drawing_ObjectStore &operator=(const Drawing_ObjectStore &) = delete;
+
+  // A budget of zero keeps every shape in memory
+  void setBudget(std::size_t bytes, const std::string &spill_path);
+
+  void emplace_back(std::shared_ptr<Drawing_Geom> object);
+  void clear();
+  std::size_t size() const { return spilled + objects.size(); }
+  std::size_t spilledCount() const { return spilled; }
+
+  // While restoring from the spill log, removes the last n decoded shapes (group members)
+  std::vector<std::shared_ptr<Drawing_Geom>> takeLast(std::size_t n);
+
+  // Calls fn with successive chunks of shapes in drawing order
+  void forEachChunk(std::size_t chunk_size, const ChunkFunction &fn);
+};
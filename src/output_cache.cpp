@@ -0,0 +1,126 @@
+#include "output_cache.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <system_error>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Bumped whenever a change to the device alters the archive it produces
+const char *Drawing_OutputCacheVersion = "v5";
+const char *Drawing_OutputCacheExtension = ".zip";
+const char *Drawing_OutputCacheTemporaryExtension = ".tmp";
+// Temporary files older than this were left by a writer that did not finish
+const std::chrono::hours Drawing_OutputCacheTemporaryAge(1);
+
+static long ProcessId() {
+#ifdef _WIN32
+  return _getpid();
+#else
+  return getpid();
+#endif
+}
+
+Drawing_OutputCache::Drawing_OutputCache(const std::string &directory, std::size_t max_bytes) {
+  this->directory = directory;
+  this->max_bytes = max_bytes;
+
+  std::error_code error;
+  fs::create_directories(directory, error);
+  if (!fs::is_directory(directory, error))
+    throw std::runtime_error("Unable to create cache directory '" + directory + "'");
+}
+
+std::string Drawing_OutputCache::path(const std::string &key) const {
+  return (fs::path(directory) / (std::string(Drawing_OutputCacheVersion) + "-" + key + Drawing_OutputCacheExtension)).string();
+}
+
+bool Drawing_OutputCache::lookup(const std::string &key, std::vector<uint8_t> &archive) {
+  std::string file = path(key);
+  std::error_code error;
+  if (!fs::is_regular_file(file, error)) return false;
+
+  try {
+    MappedFile cached(file);
+    if (cached.size() == 0) return false;
+    archive.assign(cached.data(), cached.data() + cached.size());
+  }
+
+  catch (const std::exception &) {
+    // Removed by another process since the check; treat as a miss
+    return false;
+  }
+
+  // The modification time orders archives for eviction
+  fs::last_write_time(file, fs::file_time_type::clock::now(), error);
+  return true;
+}
+
+void Drawing_OutputCache::store(const std::string &key, const std::vector<uint8_t> &archive) {
+  if (archive.size() > max_bytes) return;
+
+  // Written under a temporary name and renamed, so readers never see part of an archive.
+  // The name is unique per process, as several sessions may share the directory.
+  std::string file = path(key);
+  std::string temporary = file + "." + std::to_string(ProcessId()) + Drawing_OutputCacheTemporaryExtension;
+
+  std::FILE *out = std::fopen(temporary.c_str(), "wb");
+  if (out == nullptr) return;
+
+  bool written = std::fwrite(archive.data(), 1, archive.size(), out) == archive.size();
+  written = (std::fclose(out) == 0) && written;
+
+  std::error_code error;
+  if (written) fs::rename(temporary, file, error);
+  if (!written || error) {
+    fs::remove(temporary, error);
+    return;
+  }
+
+  evict();
+}
+
+void Drawing_OutputCache::evict() {
+  struct Entry {
+    fs::path path;
+    std::uintmax_t size;
+    fs::file_time_type used;
+  };
+
+  std::vector<Entry> entries;
+  std::uintmax_t total = 0;
+  std::error_code error;
+
+  auto stale = fs::file_time_type::clock::now() - Drawing_OutputCacheTemporaryAge;
+
+  for (fs::directory_iterator it(directory, error), end; !error && (it != end); it.increment(error)) {
+    bool temporary = it->path().extension() == Drawing_OutputCacheTemporaryExtension;
+    if (!temporary && (it->path().extension() != Drawing_OutputCacheExtension)) continue;
+
+    std::error_code entry_error;
+    Entry entry = {it->path(), it->file_size(entry_error), it->last_write_time(entry_error)};
+    if (entry_error) continue;
+
+    // Temporary files still being written count towards the size but are not evicted
+    if (temporary && (entry.used < stale) && fs::remove(entry.path, entry_error)) continue;
+
+    total += entry.size;
+    if (!temporary) entries.push_back(entry);
+  }
+
+  if (total <= max_bytes) return;
+
+  std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.used < b.used; });
+
+  for (const auto &entry : entries) {
+    if (total <= max_bytes) break;
+    if (fs::remove(entry.path, error)) total -= entry.size;
+  }
+}
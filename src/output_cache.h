@@ -0,0 +1,22 @@
+// Size-bounded on-disk cache of finished archives, keyed by the hash of the device
+// call stream and options. Each archive is a file in the cache directory; when the
+// directory grows beyond its size, the least recently used archives are removed.
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class Drawing_OutputCache {
+  std::string directory;
+  std::size_t max_bytes;
+
+  std::string path(const std::string &key) const;
+  void evict();
+
+public:
+  Drawing_OutputCache(const std::string &directory, std::size_t max_bytes);
+
+  // Fills archive and marks it as recently used when key is in the cache
+  bool lookup(const std::string &key, std::vector<uint8_t> &archive);
+  void store(const std::string &key, const std::vector<uint8_t> &archive);
+};
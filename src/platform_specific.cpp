@@ -1,19 +1,186 @@
 #include "platform_specific.h"
+#include <cstring>
+#include "utf8.h"
+#include "text_scan.h"
+#include "core_metrics.h"
 
-void PlatformDeviceDriver::TextBoundingRect(const pGEcontext gc, const std::string &text, const bool UTF8, Drawing_TextBounds &bounds) {
-    std::string fontfamily = PlatformFontFamily(gc);
+const std::size_t PlatformBoundsCacheSize = 4096;
+// Characters are measured once at this size and scaled to the size asked for. Backends
+// that round to whole pixels or points are far too coarse at 1pt.
+const double PlatformCharacterReferenceSize = 1000;
+
+const std::string& PlatformDeviceDriver::FontFamily(const pGEcontext gc) const {
+    int fontface = (gc ? gc->fontface : 0);
+    const char *fontfamily = (gc ? gc->fontfamily : "");
+
+    for (const auto& entry : fontFamilies)
+        if ((entry.fontface == fontface) && (entry.fontfamily == fontfamily)) return entry.resolved;
+
+    fontFamilies.push_back({fontface, fontfamily, PlatformFontFamily(gc)});
+    return fontFamilies.back().resolved;
+}
+
+bool PlatformDeviceDriver::TextBoundingRect(const pGEcontext gc, const std::string &text, const bool UTF8, Drawing_TextBounds &bounds) {
+    const std::string& fontfamily = FontFamily(gc);
     bool bold = (gc ? (gc->fontface == 2 || gc->fontface == 4) : false);
     bool italic = (gc ? (gc->fontface == 3 || gc->fontface == 4) : false);
+    bool symbol = (gc ? gc->fontface == 5 : false);
+    double pointsize = (gc ? gc->ps * gc->cex : 10);
+
+    // Key is family, flags and pointsize, then the text
+    std::string key;
+    key.reserve(fontfamily.size() + 2 + sizeof(pointsize) + text.size());
+    key.append(fontfamily);
+    key.push_back('\0');
+    key.push_back(static_cast<char>(bold | (italic << 1) | (symbol << 2) | (UTF8 << 3)));
+    key.append(reinterpret_cast<const char *>(&pointsize), sizeof(pointsize));
+    key.append(text);
+
+    auto found = measuredIndex.find(key);
+    if (found != measuredIndex.end()) {
+        measured.splice(measured.begin(), measured, found->second);
+        bounds = found->second->second;
+        return true;
+    }
 
     bounds.ascent = bounds.descent = bounds.width = bounds.height = 0;
+    bool found_bounds = false;
 
     try {
-        PlatformTextBoundingRect(fontfamily, bold, italic,
-            (gc ? gc->ps * gc->cex : 10),
-            text, UTF8, (gc ? gc->fontface == 5 : false), bounds);
+        found_bounds = PlatformTextBoundingRect(fontfamily, bold, italic, pointsize, text, UTF8, symbol, bounds);
     }
 
     catch (std::exception& e) {
 
     }
+
+    // Failures are not cached, so a font that could not be loaded is tried again
+    if (!found_bounds) {
+        bounds.ascent = bounds.descent = bounds.width = bounds.height = 0;
+        return false;
+    }
+
+    if (measured.size() >= PlatformBoundsCacheSize) {
+        measuredIndex.erase(measured.back().first);
+        measured.pop_back();
+    }
+
+    measured.emplace_front(key, bounds);
+    measuredIndex.emplace(std::move(key), measured.begin());
+
+    return false;
+}
+
+bool PlatformDeviceDriver::CharacterBoundingRect(const pGEcontext gc, uint32_t codepoint, Drawing_TextBounds &bounds) {
+    int fontface = (gc ? gc->fontface : 1);
+    double pointsize = (gc ? gc->ps * gc->cex : 10);
+    const std::string& fontfamily = FontFamily(gc);
+    CharacterMetrics &metrics = characterMetrics[{fontfamily, fontface}];
+
+    const Drawing_TextBounds *unit = nullptr;
+    if (codepoint < metrics.latin1.size()) {
+        if (metrics.known[codepoint]) unit = &metrics.latin1[codepoint];
+    } else {
+        auto found = metrics.other.find(codepoint);
+        if (found != metrics.other.end()) unit = &found->second;
+    }
+
+    bool cached = (unit != nullptr);
+    if (!cached) {
+        std::string text;
+        try {
+            utf8::append(codepoint, std::back_inserter(text));
+        }
+
+        catch (std::exception& e) {
+
+        }
+
+        Drawing_TextBounds reference = {0, 0, 0, 0};
+        bool measured = false;
+
+        try {
+            measured = PlatformTextBoundingRect(fontfamily, fontface == 2 || fontface == 4, fontface == 3 || fontface == 4,
+                PlatformCharacterReferenceSize, text, true, fontface == 5, reference);
+        }
+
+        catch (std::exception& e) {
+
+        }
+
+        // A failed measurement is not kept, so the character is tried again next time
+        if (!measured) {
+            bounds.ascent = bounds.descent = bounds.width = bounds.height = 0;
+            return false;
+        }
+
+        Drawing_TextBounds scaled = {reference.width / PlatformCharacterReferenceSize,
+                                     reference.height / PlatformCharacterReferenceSize,
+                                     reference.ascent / PlatformCharacterReferenceSize,
+                                     reference.descent / PlatformCharacterReferenceSize};
+
+        if (codepoint < metrics.latin1.size()) {
+            metrics.latin1[codepoint] = scaled;
+            metrics.known[codepoint] = true;
+            unit = &metrics.latin1[codepoint];
+        } else {
+            unit = &(metrics.other[codepoint] = scaled);
+        }
+    }
+
+    bounds.ascent = unit->ascent * pointsize;
+    bounds.descent = unit->descent * pointsize;
+    bounds.width = unit->width * pointsize;
+    bounds.height = unit->height * pointsize;
+
+    return cached;
+}
+
+static const Drawing_CoreFont *FindCoreFont(const std::string& family, const bool bold, const bool italic) {
+    const char *name = family.c_str();
+    if (family == "Courier") name = "Courier New";
+
+    for (const auto& font : Drawing_CoreFonts)
+        if ((strcmp(font.family, name) == 0) && (font.bold == bold) && (font.italic == italic)) return &font;
+
+    return nullptr;
+}
+
+bool CoreFontFamily(const std::string& family) {
+#ifdef DRAWING_HARFBUZZ
+    // Shaped builds measure every family from its font file
+    return false;
+#else
+    return FindCoreFont(family, false, false) != nullptr;
+#endif
+}
+
+bool CoreFontTextBoundingRect(const std::string& family, const bool bold, const bool italic, const double pointsize,
+                              const std::string& text, const bool UTF8, Drawing_TextBounds& bounds) {
+    const Drawing_CoreFont *font = FindCoreFont(family, bold, italic);
+    if (font == nullptr) return false;
+
+    long total_advance = 0;
+
+    if (!UTF8 || Drawing_IsASCII(text.data(), text.size())) {
+        for (char c : text)
+            total_advance += font->widths[static_cast<uint8_t>(c)];
+    } else {
+        const char *pos = text.data();
+        const char *end = pos + text.size();
+        uint32_t charcode;
+
+        // Measurement stops at the first invalid sequence
+        while (Drawing_NextCodepoint(pos, end, charcode)) {
+            if (charcode > 255) return false;
+            total_advance += font->widths[charcode];
+        }
+    }
+
+    bounds.ascent = font->ascent / 1000.0 * pointsize;
+    bounds.descent = font->descent / 1000.0 * pointsize;
+    bounds.height = bounds.ascent - bounds.descent;
+    bounds.width = total_advance / 1000.0 * pointsize;
+
+    return true;
 }
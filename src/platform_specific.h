@@ -6,7 +6,12 @@
 #include <R_ext/Rdynload.h>
 #include <R_ext/GraphicsEngine.h>
 #include <string>
+#include <vector>
 #include <memory>
+#include <list>
+#include <unordered_map>
+#include <map>
+#include <array>
 
 struct Drawing_TextBounds {
   double width;
@@ -18,13 +23,58 @@ struct Drawing_TextBounds {
 };
 
 class PlatformDeviceDriver {
+  // Resolved PlatformFontFamily() per gc->fontfamily / gc->fontface pair; a list so that
+  // references returned by FontFamily() survive later insertions
+  struct FontFamilyEntry {
+    int fontface;
+    std::string fontfamily;
+    std::string resolved;
+  };
+  mutable std::list<FontFamilyEntry> fontFamilies;
+
+  // Measured strings by (text, family, face, size), least recently used last
+  typedef std::pair<std::string, Drawing_TextBounds> BoundsEntry;
+  std::list<BoundsEntry> measured;
+  std::unordered_map<std::string, std::list<BoundsEntry>::iterator> measuredIndex;
+
+  // Single character bounds per point for one family and fontface; codepoints 0-255
+  // are a dense table, others are added to a map as they are first measured
+  struct CharacterMetrics {
+    std::array<Drawing_TextBounds, 256> latin1;
+    std::array<bool, 256> known;
+    std::unordered_map<uint32_t, Drawing_TextBounds> other;
+
+    CharacterMetrics() { known.fill(false); }
+  };
+  std::map<std::pair<std::string, int>, CharacterMetrics> characterMetrics;
+
   public:
   PlatformDeviceDriver() {};
   virtual ~PlatformDeviceDriver() {};
 
-  virtual void TextBoundingRect(const pGEcontext gc, const std::string& text, const bool UTF8,
+  // Returns true when the bounds came from the cache rather than the font backend
+  virtual bool TextBoundingRect(const pGEcontext gc, const std::string& text, const bool UTF8,
                                 Drawing_TextBounds& bounds);
 
+  // Bounds of a single character, scaled from the per-font table; returns true when already in the table
+  bool CharacterBoundingRect(const pGEcontext gc, uint32_t codepoint, Drawing_TextBounds& bounds);
+
+  // Cached PlatformFontFamily(); the reference is valid for the life of the driver
+  const std::string& FontFamily(const pGEcontext gc) const;
+
+  // Metrics kept on disk between sessions, for backends that measure from font files.
+  // Saving writes back only the cache this driver opened.
+  virtual void OpenMetricsCache(const std::string& path) {};
+  virtual void SaveMetricsCache() {};
+
+  // Identifies what measurements depend on beyond the font requested, such as the
+  // installed fonts and how text is shaped; mixed into the output cache key
+  virtual std::string MetricsFingerprint() { return ""; };
+
+  // Starts loading the regular, bold and italic fonts of a family in the background, so
+  // that the first text measured in them does not wait for font loading
+  virtual void WarmUp(const std::string& family) {};
+
   virtual std::string PlatformFontFamily(const pGEcontext gc) const { return ""; };
   virtual bool PlatformTextBoundingRect(const std::string& family, const bool bold, const bool italic, const double pointsize,
                                         const std::string& text, const bool UTF8, const bool symbol,
@@ -33,5 +83,16 @@ class PlatformDeviceDriver {
 
 std::unique_ptr<PlatformDeviceDriver> NewPlatformDeviceDriver();
 
+// A driver that may measure text on a worker thread, alongside other measurers and the
+// devices. Returns nullptr where text can only be measured on the main thread.
+std::unique_ptr<PlatformDeviceDriver> NewPlatformTextMeasurer();
 
+// Measures text in Arial, Times New Roman or Courier (New) from the built-in metrics in
+// core_metrics.h. Returns false for other families or text outside Latin-1. Builds with
+// HarfBuzz shaping use it only when the font file cannot be loaded.
+bool CoreFontTextBoundingRect(const std::string& family, const bool bold, const bool italic, const double pointsize,
+                              const std::string& text, const bool UTF8, Drawing_TextBounds& bounds);
 
+// True when the family's Latin-1 text is measured from the built-in metrics; always
+// false with HarfBuzz shaping
+bool CoreFontFamily(const std::string& family);
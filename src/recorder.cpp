@@ -0,0 +1,473 @@
+#include <Rcpp.h>
+#include "drawing_device.h"
+#include "drawingml.h"
+#include "recorder.h"
+#include "zip_container.h"
+#include <vector>
+
+const uint32_t Drawing_RecordMagic = 0x4C445252; // "RRDL"
+const uint64_t Drawing_RecordVersion = 1;
+const uint64_t Drawing_StreamHashPrime[2] = {0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL};
+
+// Buffered calls are written to the log in blocks of about this size
+const std::size_t Drawing_RecordBlockSize = 1 << 20;
+// Points are stored in units of 2^-24 pt, far finer than the 1/12700 pt of an EMU
+const double Drawing_RecordPointScale = 16777216.0;
+// Larger (or non-finite) coordinates are stored as raw doubles
+const double Drawing_RecordPointLimit = 268435456.0;
+
+// Graphics context fields, one bit each in the change mask written before a call
+enum Drawing_RecordField {
+  DRAWING_GC_COL = 1 << 0,
+  DRAWING_GC_FILL = 1 << 1,
+  DRAWING_GC_LWD = 1 << 2,
+  DRAWING_GC_LTY = 1 << 3,
+  DRAWING_GC_LEND = 1 << 4,
+  DRAWING_GC_LJOIN = 1 << 5,
+  DRAWING_GC_LMITRE = 1 << 6,
+  DRAWING_GC_CEX = 1 << 7,
+  DRAWING_GC_PS = 1 << 8,
+  DRAWING_GC_LINEHEIGHT = 1 << 9,
+  DRAWING_GC_FONTFACE = 1 << 10,
+  DRAWING_GC_FONTFAMILY = 1 << 11,
+  DRAWING_GC_NULL = 1 << 12
+};
+
+// Bitwise comparison, so NA and NaN values compare equal to themselves
+static bool same(double a, double b) {
+  return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+Drawing_Recorder::Drawing_Recorder(const std::string &path, const Drawing_RecordHeader &header) : path(path), out(buffer) {
+  file = nullptr;
+  if (!path.empty()) {
+    file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+      throw std::runtime_error("Unable to create recording '" + path + "'");
+  }
+
+  active = true;
+  have_last = false;
+
+  out.put_u32(Drawing_RecordMagic);
+  out.put_varint(Drawing_RecordVersion);
+  out.put_double(header.width);
+  out.put_double(header.height);
+  out.put_double(header.pointsize);
+  out.put_string(header.font);
+}
+
+Drawing_Recorder::~Drawing_Recorder() {
+  if (file) {
+    std::fwrite(buffer.data(), 1, buffer.size(), file);
+    std::fclose(file);
+  }
+}
+
+void Drawing_Recorder::flush() {
+  hash.update(buffer.data(), buffer.size());
+
+  if (file && (std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()))
+    throw std::runtime_error("Unable to write to recording '" + path + "'");
+  buffer.clear();
+}
+
+void Drawing_Recorder::close() {
+  if (!active) return;
+
+  flush();
+  active = false;
+  if (file == nullptr) return;
+
+  bool failed = std::fclose(file) != 0;
+  file = nullptr;
+
+  if (failed)
+    throw std::runtime_error("Unable to write to recording '" + path + "'");
+}
+
+void Drawing_Recorder::op(Drawing_RecordOp op, const pGEcontext gc) {
+  if (!active) return;
+  if (buffer.size() >= Drawing_RecordBlockSize) flush();
+
+  out.put_u8(op);
+
+  if (gc == NULL) {
+    out.put_varint(DRAWING_GC_NULL);
+    return;
+  }
+
+  unsigned int mask = 0;
+  if (!have_last || gc->col != last.col) mask |= DRAWING_GC_COL;
+  if (!have_last || gc->fill != last.fill) mask |= DRAWING_GC_FILL;
+  if (!have_last || !same(gc->lwd, last.lwd)) mask |= DRAWING_GC_LWD;
+  if (!have_last || gc->lty != last.lty) mask |= DRAWING_GC_LTY;
+  if (!have_last || gc->lend != last.lend) mask |= DRAWING_GC_LEND;
+  if (!have_last || gc->ljoin != last.ljoin) mask |= DRAWING_GC_LJOIN;
+  if (!have_last || !same(gc->lmitre, last.lmitre)) mask |= DRAWING_GC_LMITRE;
+  if (!have_last || !same(gc->cex, last.cex)) mask |= DRAWING_GC_CEX;
+  if (!have_last || !same(gc->ps, last.ps)) mask |= DRAWING_GC_PS;
+  if (!have_last || !same(gc->lineheight, last.lineheight)) mask |= DRAWING_GC_LINEHEIGHT;
+  if (!have_last || gc->fontface != last.fontface) mask |= DRAWING_GC_FONTFACE;
+  if (!have_last || std::strcmp(gc->fontfamily, last.fontfamily) != 0) mask |= DRAWING_GC_FONTFAMILY;
+
+  out.put_varint(mask);
+  if (mask & DRAWING_GC_COL) out.put_u32(static_cast<uint32_t>(gc->col));
+  if (mask & DRAWING_GC_FILL) out.put_u32(static_cast<uint32_t>(gc->fill));
+  if (mask & DRAWING_GC_LWD) out.put_double(gc->lwd);
+  if (mask & DRAWING_GC_LTY) out.put_svarint(gc->lty);
+  if (mask & DRAWING_GC_LEND) out.put_varint(gc->lend);
+  if (mask & DRAWING_GC_LJOIN) out.put_varint(gc->ljoin);
+  if (mask & DRAWING_GC_LMITRE) out.put_double(gc->lmitre);
+  if (mask & DRAWING_GC_CEX) out.put_double(gc->cex);
+  if (mask & DRAWING_GC_PS) out.put_double(gc->ps);
+  if (mask & DRAWING_GC_LINEHEIGHT) out.put_double(gc->lineheight);
+  if (mask & DRAWING_GC_FONTFACE) out.put_svarint(gc->fontface);
+  if (mask & DRAWING_GC_FONTFAMILY) out.put_string(gc->fontfamily);
+
+  last = *gc;
+  have_last = true;
+}
+
+Drawing_StreamHash::Drawing_StreamHash() {
+  state[0] = 0x243F6A8885A308D3ULL;
+  state[1] = 0x13198A2E03707344ULL;
+  length = 0;
+  tail = 0;
+}
+
+void Drawing_StreamHash::mix(uint64_t word) {
+  for (int lane = 0; lane < 2; lane++) {
+    state[lane] = (state[lane] ^ word) * Drawing_StreamHashPrime[lane];
+    state[lane] ^= state[lane] >> 29;
+  }
+}
+
+void Drawing_StreamHash::update(const char *data, std::size_t size) {
+  const char *end = data + size;
+
+  // Complete a word left over from the previous update
+  while ((data < end) && (length % 8 != 0)) {
+    tail |= static_cast<uint64_t>(static_cast<uint8_t>(*data++)) << (8 * (length % 8));
+    if (++length % 8 == 0) {
+      mix(tail);
+      tail = 0;
+    }
+  }
+
+  for (; end - data >= 8; data += 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    mix(word);
+    length += 8;
+  }
+
+  while (data < end)
+    tail |= static_cast<uint64_t>(static_cast<uint8_t>(*data++)) << (8 * (length++ % 8));
+}
+
+std::string Drawing_StreamHash::str() const {
+  uint64_t h[2] = {state[0], state[1]};
+  char hex[33];
+
+  for (int lane = 0; lane < 2; lane++) {
+    // Finalise with the tail and length, then the MurmurHash3 avalanche
+    h[lane] = (h[lane] ^ tail) * Drawing_StreamHashPrime[lane];
+    h[lane] ^= length;
+    h[lane] ^= h[lane] >> 33;
+    h[lane] *= 0xFF51AFD7ED558CCDULL;
+    h[lane] ^= h[lane] >> 33;
+    h[lane] *= 0xC4CEB9FE1A85EC53ULL;
+    h[lane] ^= h[lane] >> 33;
+  }
+
+  std::snprintf(hex, sizeof(hex), "%016llx%016llx", static_cast<unsigned long long>(h[0]), static_cast<unsigned long long>(h[1]));
+  return hex;
+}
+
+// Each coordinate is the difference from the previous one on the same axis,
+// zigzag encoded and doubled; an odd value of 1 escapes a raw double
+static void encode_coordinate(Drawing_BinaryWriter &out, double v, int64_t &previous) {
+  if (std::isfinite(v) && (std::fabs(v) < Drawing_RecordPointLimit)) {
+    int64_t q = std::llround(v * Drawing_RecordPointScale);
+    out.put_svarint((q - previous) * 2);
+    previous = q;
+  } else {
+    out.put_svarint(1);
+    out.put_double(v);
+  }
+}
+
+static double decode_coordinate(Drawing_BinaryReader &in, int64_t &previous) {
+  int64_t v = in.get_svarint();
+  if (v & 1) return in.get_double();
+
+  previous += v / 2;
+  return previous / Drawing_RecordPointScale;
+}
+
+void Drawing_Recorder::points(int n, const double *x, const double *y) {
+  if (n < 0) n = 0;
+  out.put_varint(n);
+
+  int64_t previous_x = 0, previous_y = 0;
+  for (int idx = 0; idx < n; idx++) {
+    encode_coordinate(out, x[idx], previous_x);
+    encode_coordinate(out, y[idx], previous_y);
+  }
+}
+
+static void encode_str(Drawing_BinaryWriter &out, const char *str) {
+  out.put_u8(str != NULL);
+  if (str) out.put_string(str);
+}
+
+std::string Drawing_Recorder::digest() {
+  if (active) flush();
+  return hash.str();
+}
+
+void Drawing_Recorder::newPage(double width, double height) {
+  op(DRAWING_OP_NEWPAGE, NULL);
+  if (!active) return;
+  out.put_double(width);
+  out.put_double(height);
+}
+
+void Drawing_Recorder::metricInfo(int c, const pGEcontext gc) {
+  op(DRAWING_OP_METRICINFO, gc);
+  if (!active) return;
+  out.put_svarint(c);
+}
+
+void Drawing_Recorder::strWidth(const char *str, const pGEcontext gc) {
+  op(DRAWING_OP_STRWIDTH, gc);
+  if (!active) return;
+  encode_str(out, str);
+}
+
+void Drawing_Recorder::rect(double x0, double y0, double x1, double y1, const pGEcontext gc) {
+  op(DRAWING_OP_RECT, gc);
+  if (!active) return;
+  out.put_double(x0);
+  out.put_double(y0);
+  out.put_double(x1);
+  out.put_double(y1);
+}
+
+void Drawing_Recorder::line(double x1, double y1, double x2, double y2, const pGEcontext gc) {
+  op(DRAWING_OP_LINE, gc);
+  if (!active) return;
+  out.put_double(x1);
+  out.put_double(y1);
+  out.put_double(x2);
+  out.put_double(y2);
+}
+
+void Drawing_Recorder::circle(double x, double y, double r, const pGEcontext gc) {
+  op(DRAWING_OP_CIRCLE, gc);
+  if (!active) return;
+  out.put_double(x);
+  out.put_double(y);
+  out.put_double(r);
+}
+
+void Drawing_Recorder::polyline(int n, const double *x, const double *y, const pGEcontext gc) {
+  op(DRAWING_OP_POLYLINE, gc);
+  if (!active) return;
+  points(n, x, y);
+}
+
+void Drawing_Recorder::polygon(int n, const double *x, const double *y, const pGEcontext gc) {
+  op(DRAWING_OP_POLYGON, gc);
+  if (!active) return;
+  points(n, x, y);
+}
+
+void Drawing_Recorder::text(double x, double y, const char *str, double rot, double hadj, const pGEcontext gc) {
+  op(DRAWING_OP_TEXT, gc);
+  if (!active) return;
+  out.put_double(x);
+  out.put_double(y);
+  encode_str(out, str);
+  out.put_double(rot);
+  out.put_double(hadj);
+}
+
+Drawing_Replayer::Drawing_Replayer(const std::string &path) : log(path) {
+  Drawing_BinaryReader in(log.data(), log.size());
+
+  if (log.size() < sizeof(uint32_t) || in.get_u32() != Drawing_RecordMagic)
+    throw std::runtime_error("'" + path + "' is not a DrawingDevice recording");
+  if (in.get_varint() != Drawing_RecordVersion)
+    throw std::runtime_error("Unsupported version of DrawingDevice recording '" + path + "'");
+
+  header.width = in.get_double();
+  header.height = in.get_double();
+  header.pointsize = in.get_double();
+  header.font = in.get_string();
+}
+
+static pGEcontext decode_gc(Drawing_BinaryReader &in, R_GE_gcontext &gc) {
+  uint64_t mask = in.get_varint();
+  if (mask & DRAWING_GC_NULL) return NULL;
+
+  if (mask & DRAWING_GC_COL) gc.col = static_cast<int>(in.get_u32());
+  if (mask & DRAWING_GC_FILL) gc.fill = static_cast<int>(in.get_u32());
+  if (mask & DRAWING_GC_LWD) gc.lwd = in.get_double();
+  if (mask & DRAWING_GC_LTY) gc.lty = static_cast<int>(in.get_svarint());
+  if (mask & DRAWING_GC_LEND) gc.lend = static_cast<R_GE_lineend>(in.get_varint());
+  if (mask & DRAWING_GC_LJOIN) gc.ljoin = static_cast<R_GE_linejoin>(in.get_varint());
+  if (mask & DRAWING_GC_LMITRE) gc.lmitre = in.get_double();
+  if (mask & DRAWING_GC_CEX) gc.cex = in.get_double();
+  if (mask & DRAWING_GC_PS) gc.ps = in.get_double();
+  if (mask & DRAWING_GC_LINEHEIGHT) gc.lineheight = in.get_double();
+  if (mask & DRAWING_GC_FONTFACE) gc.fontface = static_cast<int>(in.get_svarint());
+  if (mask & DRAWING_GC_FONTFAMILY) {
+    std::string family = in.get_string();
+    std::strncpy(gc.fontfamily, family.c_str(), sizeof(gc.fontfamily) - 1);
+    gc.fontfamily[sizeof(gc.fontfamily) - 1] = 0;
+  }
+
+  return &gc;
+}
+
+static void decode_points(Drawing_BinaryReader &in, std::vector<double> &x, std::vector<double> &y) {
+  uint64_t n = in.get_varint();
+  x.resize(n);
+  y.resize(n);
+
+  int64_t previous_x = 0, previous_y = 0;
+  for (uint64_t idx = 0; idx < n; idx++) {
+    x[idx] = decode_coordinate(in, previous_x);
+    y[idx] = decode_coordinate(in, previous_y);
+  }
+}
+
+static bool decode_str(Drawing_BinaryReader &in, std::string &str) {
+  if (in.get_u8() == 0) return false;
+  str = in.get_string();
+  return true;
+}
+
+void Drawing_Replayer::replay(Drawing_Context &context) {
+  Drawing_BinaryReader in(log.data(), log.size());
+  in.get_u32();
+  in.get_varint();
+  in.get_double();
+  in.get_double();
+  in.get_double();
+  in.get_string();
+
+  R_GE_gcontext state;
+  std::memset(&state, 0, sizeof(state));
+  std::vector<double> x, y;
+  std::string str;
+
+  while (!in.eof()) {
+    Drawing_RecordOp op = static_cast<Drawing_RecordOp>(in.get_u8());
+    pGEcontext gc = decode_gc(in, state);
+
+    switch (op) {
+      case DRAWING_OP_NEWPAGE: {
+        double width = in.get_double();
+        double height = in.get_double();
+        Drawing_newPage(context, width, height);
+        break;
+      }
+
+      case DRAWING_OP_METRICINFO: {
+        int c = static_cast<int>(in.get_svarint());
+        double ascent, descent, width;
+        Drawing_metricInfo(context, c, gc, &ascent, &descent, &width);
+        break;
+      }
+
+      case DRAWING_OP_STRWIDTH: {
+        bool present = decode_str(in, str);
+        Drawing_strWidth(context, present ? str.c_str() : NULL, gc);
+        break;
+      }
+
+      case DRAWING_OP_RECT: {
+        double x0 = in.get_double();
+        double y0 = in.get_double();
+        double x1 = in.get_double();
+        double y1 = in.get_double();
+        Drawing_rect(context, x0, y0, x1, y1, gc);
+        break;
+      }
+
+      case DRAWING_OP_LINE: {
+        double x1 = in.get_double();
+        double y1 = in.get_double();
+        double x2 = in.get_double();
+        double y2 = in.get_double();
+        Drawing_line(context, x1, y1, x2, y2, gc);
+        break;
+      }
+
+      case DRAWING_OP_CIRCLE: {
+        double cx = in.get_double();
+        double cy = in.get_double();
+        double r = in.get_double();
+        Drawing_circle(context, cx, cy, r, gc);
+        break;
+      }
+
+      case DRAWING_OP_POLYLINE:
+        decode_points(in, x, y);
+        Drawing_polyline(context, static_cast<int>(x.size()), x.data(), y.data(), gc);
+        break;
+
+      case DRAWING_OP_POLYGON:
+        decode_points(in, x, y);
+        Drawing_polygon(context, static_cast<int>(x.size()), x.data(), y.data(), gc);
+        break;
+
+      case DRAWING_OP_TEXT: {
+        double tx = in.get_double();
+        double ty = in.get_double();
+        bool present = decode_str(in, str);
+        double rot = in.get_double();
+        double hadj = in.get_double();
+        Drawing_text(context, tx, ty, present ? str.c_str() : NULL, rot, hadj, gc);
+        break;
+      }
+
+      default:
+        throw std::runtime_error("Unknown call in DrawingDevice recording");
+    }
+  }
+}
+
+// Replays a recording made with DrawingDevice(record = ...) and exports the result as the device would on close
+// [[Rcpp::export]]
+void DrawingReplay(std::string path, double memory_budget = 0, std::string diagnostics = "warning") {
+  if (std::isnan(memory_budget) || (memory_budget < 0)) memory_budget = 0;
+  Drawing_DiagnosticLevel diagnostics_level = Drawing_DiagnosticLevel_parse(diagnostics);
+
+  std::string spill_path;
+  if (memory_budget > 0) {
+    Rcpp::Function tempfile("tempfile");
+    spill_path = Rcpp::as<std::string>(tempfile("RDrawing", Rcpp::Named("fileext") = ".spill"));
+  }
+
+  Drawing_Replayer replayer(path);
+
+  std::unique_ptr<DrawingML_Context> context(new DrawingML_Context());
+  context->objects.setBudget(static_cast<std::size_t>(memory_budget * 1024 * 1024), spill_path);
+  context->diagnostics.setLevel(diagnostics_level);
+
+  replayer.replay(*context);
+  context->diagnostics.summary();
+
+  std::vector<std::pair<std::string, std::string>> container;
+  {
+    Drawing_ScopedTimer timer(context->stats, DRAWING_TIME_XML);
+    container = context->container();
+  }
+
+  ZipAndSendToClipboard(container, context->stats);
+  Drawing_LastStats = context->stats;
+}
@@ -0,0 +1,103 @@
+// Recording of the device call stream. Every DrawingDevice_* callback is appended
+// to a compact binary log: an opcode, the graphics context fields that changed
+// since the previous call, and the arguments. Polyline and polygon points are
+// delta-encoded in fixed point. Drawing_Replayer feeds a log back into any
+// Drawing_Context without running R code, so slow exports can be reproduced,
+// profiled and re-rendered with different device options. The recorder also keeps
+// a running hash of the stream, which identifies the drawing for the output cache.
+#pragma once
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/GraphicsEngine.h>
+#include <cstdio>
+#include <string>
+#include "binary_io.h"
+#include "mapped_file.h"
+
+struct Drawing_Context;
+
+enum Drawing_RecordOp {
+  DRAWING_OP_NEWPAGE = 1,
+  DRAWING_OP_METRICINFO,
+  DRAWING_OP_STRWIDTH,
+  DRAWING_OP_RECT,
+  DRAWING_OP_LINE,
+  DRAWING_OP_CIRCLE,
+  DRAWING_OP_POLYLINE,
+  DRAWING_OP_POLYGON,
+  DRAWING_OP_TEXT
+};
+
+// Device options given when the log was recorded
+struct Drawing_RecordHeader {
+  double width;
+  double height;
+  double pointsize;
+  std::string font;
+};
+
+// 128 bit non-cryptographic hash, fed incrementally
+class Drawing_StreamHash {
+  uint64_t state[2];
+  uint64_t length;
+  uint64_t tail;
+
+  void mix(uint64_t word);
+
+public:
+  Drawing_StreamHash();
+  void update(const char *data, std::size_t size);
+  // Hex digest of everything fed so far
+  std::string str() const;
+};
+
+class Drawing_Recorder {
+  std::string path;
+  std::FILE *file;
+  bool active;
+  Drawing_StreamHash hash;
+  std::string buffer;
+  Drawing_BinaryWriter out;
+  R_GE_gcontext last;
+  bool have_last;
+
+  void op(Drawing_RecordOp op, const pGEcontext gc);
+  void points(int n, const double *x, const double *y);
+  void flush();
+
+public:
+  // An empty path only hashes the stream
+  Drawing_Recorder(const std::string &path, const Drawing_RecordHeader &header);
+  ~Drawing_Recorder();
+  Drawing_Recorder(const Drawing_Recorder &) = delete;
+  Drawing_Recorder &operator=(const Drawing_Recorder &) = delete;
+
+  void newPage(double width, double height);
+  void metricInfo(int c, const pGEcontext gc);
+  void strWidth(const char *str, const pGEcontext gc);
+  void rect(double x0, double y0, double x1, double y1, const pGEcontext gc);
+  void line(double x1, double y1, double x2, double y2, const pGEcontext gc);
+  void circle(double x, double y, double r, const pGEcontext gc);
+  void polyline(int n, const double *x, const double *y, const pGEcontext gc);
+  void polygon(int n, const double *x, const double *y, const pGEcontext gc);
+  void text(double x, double y, const char *str, double rot, double hadj, const pGEcontext gc);
+
+  // Writes out anything buffered; the log is complete once this returns
+  void close();
+
+  // Hash of the header and every call recorded so far
+  std::string digest();
+};
+
+class Drawing_Replayer {
+  MappedFile log;
+  Drawing_RecordHeader header;
+
+public:
+  Drawing_Replayer(const std::string &path);
+
+  const Drawing_RecordHeader &options() const { return header; }
+
+  // Makes every recorded call against context, in order
+  void replay(Drawing_Context &context);
+};
@@ -0,0 +1,86 @@
+#include <Rcpp.h>
+#include "drawing_device.h"
+#include "stats.h"
+
+Drawing_Stats Drawing_LastStats;
+Drawing_CacheStats Drawing_OutputCacheStats = {0, 0, 0};
+
+static const char *Drawing_CallbackNames[DRAWING_CALL_COUNT] = {
+  "rect", "line", "circle", "polyline", "polygon", "text", "metricInfo", "strWidth"
+};
+
+static const char *Drawing_TimerNames[DRAWING_TIME_COUNT] = {
+  "text_metrics", "xml", "deflate", "clipboard"
+};
+
+void Drawing_Stats::reset() {
+  calls.fill(0);
+  points = 0;
+  text_cache_hits = 0;
+  text_cache_misses = 0;
+  seconds.fill(0);
+  parts.clear();
+  archive_bytes = 0;
+  cache_hit = false;
+  interrupted = false;
+}
+
+// Stats for the current device if it is a DrawingDevice, otherwise for the last one closed
+// [[Rcpp::export]]
+Rcpp::List DrawingStats() {
+  const Drawing_Stats *stats = &Drawing_LastStats;
+
+  if (!NoDevices()) {
+    pGEDevDesc gdd = GEgetDevice(curDevice());
+    if (gdd && gdd->dev && (gdd->dev->close == DrawingDevice_close) && gdd->dev->deviceSpecific)
+      stats = &static_cast<Drawing_Context *>(gdd->dev->deviceSpecific)->stats;
+  }
+
+  Rcpp::NumericVector calls(DRAWING_CALL_COUNT);
+  Rcpp::CharacterVector call_names(DRAWING_CALL_COUNT);
+  for (int idx = 0; idx < DRAWING_CALL_COUNT; idx++) {
+    calls[idx] = static_cast<double>(stats->calls[idx]);
+    call_names[idx] = Drawing_CallbackNames[idx];
+  }
+  calls.names() = call_names;
+
+  Rcpp::NumericVector seconds(DRAWING_TIME_COUNT);
+  Rcpp::CharacterVector timer_names(DRAWING_TIME_COUNT);
+  for (int idx = 0; idx < DRAWING_TIME_COUNT; idx++) {
+    seconds[idx] = stats->seconds[idx];
+    timer_names[idx] = Drawing_TimerNames[idx];
+  }
+  seconds.names() = timer_names;
+
+  Rcpp::CharacterVector part_names(stats->parts.size());
+  Rcpp::NumericVector part_bytes(stats->parts.size());
+  Rcpp::NumericVector part_compressed(stats->parts.size());
+  for (std::size_t idx = 0; idx < stats->parts.size(); idx++) {
+    part_names[idx] = stats->parts[idx].name;
+    part_bytes[idx] = static_cast<double>(stats->parts[idx].bytes);
+    part_compressed[idx] = static_cast<double>(stats->parts[idx].compressed);
+  }
+
+  return Rcpp::List::create(
+    Rcpp::Named("calls") = calls,
+    Rcpp::Named("points") = static_cast<double>(stats->points),
+    Rcpp::Named("text_cache") = Rcpp::NumericVector::create(
+      Rcpp::Named("hits") = static_cast<double>(stats->text_cache_hits),
+      Rcpp::Named("misses") = static_cast<double>(stats->text_cache_misses)),
+    Rcpp::Named("seconds") = seconds,
+    Rcpp::Named("parts") = Rcpp::DataFrame::create(
+      Rcpp::Named("name") = part_names,
+      Rcpp::Named("bytes") = part_bytes,
+      Rcpp::Named("compressed") = part_compressed,
+      Rcpp::Named("stringsAsFactors") = false),
+    Rcpp::Named("archive_bytes") = static_cast<double>(stats->archive_bytes),
+    Rcpp::Named("cache_hit") = stats->cache_hit,
+    Rcpp::Named("interrupted") = stats->interrupted,
+    Rcpp::Named("cache") = Rcpp::List::create(
+      Rcpp::Named("lookups") = static_cast<double>(Drawing_OutputCacheStats.lookups),
+      Rcpp::Named("hits") = static_cast<double>(Drawing_OutputCacheStats.hits),
+      Rcpp::Named("hit_rate") = Drawing_OutputCacheStats.lookups ?
+        static_cast<double>(Drawing_OutputCacheStats.hits) / Drawing_OutputCacheStats.lookups : 0.0,
+      Rcpp::Named("bytes_saved") = static_cast<double>(Drawing_OutputCacheStats.bytes_saved))
+  );
+}
@@ -0,0 +1,73 @@
+// Per-device performance counters, returned to R by drawing_stats()
+#pragma once
+#include <array>
+#include <chrono>
+#include <string>
+#include <vector>
+
+enum Drawing_Callback {
+  DRAWING_CALL_RECT,
+  DRAWING_CALL_LINE,
+  DRAWING_CALL_CIRCLE,
+  DRAWING_CALL_POLYLINE,
+  DRAWING_CALL_POLYGON,
+  DRAWING_CALL_TEXT,
+  DRAWING_CALL_METRICINFO,
+  DRAWING_CALL_STRWIDTH,
+  DRAWING_CALL_COUNT
+};
+
+enum Drawing_Timer {
+  DRAWING_TIME_TEXT_METRICS,
+  DRAWING_TIME_XML,
+  DRAWING_TIME_DEFLATE,
+  DRAWING_TIME_CLIPBOARD,
+  DRAWING_TIME_COUNT
+};
+
+struct Drawing_PartStats {
+  std::string name;
+  std::size_t bytes;
+  std::size_t compressed;
+};
+
+struct Drawing_Stats {
+  std::array<std::size_t, DRAWING_CALL_COUNT> calls;
+  std::size_t points;
+  std::size_t text_cache_hits;
+  std::size_t text_cache_misses;
+  std::array<double, DRAWING_TIME_COUNT> seconds;
+  std::vector<Drawing_PartStats> parts;
+  std::size_t archive_bytes;
+  bool cache_hit;
+  bool interrupted; // the export was stopped by the user while closing
+
+  Drawing_Stats() { reset(); }
+  void reset();
+};
+
+// Adds the lifetime of the timer to one of the stats' timings
+class Drawing_ScopedTimer {
+  Drawing_Stats &stats;
+  Drawing_Timer timer;
+  std::chrono::steady_clock::time_point started;
+
+public:
+  Drawing_ScopedTimer(Drawing_Stats &stats, Drawing_Timer timer) :
+    stats(stats), timer(timer), started(std::chrono::steady_clock::now()) {}
+
+  ~Drawing_ScopedTimer() {
+    stats.seconds[timer] += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  }
+};
+
+// Output cache use by every device closed in this session
+struct Drawing_CacheStats {
+  std::size_t lookups;
+  std::size_t hits;
+  std::size_t bytes_saved;
+};
+
+// Stats of the most recently closed device
+extern Drawing_Stats Drawing_LastStats;
+extern Drawing_CacheStats Drawing_OutputCacheStats;
@@ -0,0 +1,123 @@
+#include <Rcpp.h>
+#include "platform_specific.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <thread>
+
+// Strings are handed to the workers in blocks of this many
+const std::size_t Drawing_MeasureBlockSize = 256;
+
+struct Drawing_MeasureRequest {
+  std::string text;
+  R_GE_gcontext gc;
+  bool missing;
+};
+
+static void Drawing_MeasureBlocks(PlatformDeviceDriver &driver, const std::vector<Drawing_MeasureRequest> &requests,
+                                  std::vector<Drawing_TextBounds> &bounds, std::atomic<std::size_t> &next) {
+  for (;;) {
+    std::size_t first = next.fetch_add(Drawing_MeasureBlockSize);
+    if (first >= requests.size()) return;
+
+    std::size_t last = std::min(first + Drawing_MeasureBlockSize, requests.size());
+    for (std::size_t idx = first; idx < last; idx++) {
+      if (requests[idx].missing) continue;
+      driver.TextBoundingRect(const_cast<pGEcontext>(&requests[idx].gc), requests[idx].text, true, bounds[idx]);
+    }
+  }
+}
+
+// Width, ascent and descent (below the baseline, positive) in points of every string,
+// measured as the device would measure it. family, fontface and size are recycled to
+// the length of text. threads = 0 uses every core.
+// [[Rcpp::export]]
+Rcpp::NumericMatrix DrawingTextMetrics(Rcpp::CharacterVector text, Rcpp::CharacterVector family,
+                                       Rcpp::IntegerVector fontface, Rcpp::NumericVector size, int threads = 0) {
+  R_xlen_t n = text.size();
+  if ((n > 0) && ((family.size() == 0) || (fontface.size() == 0) || (size.size() == 0)))
+    Rcpp::stop("family, fontface and size must not be empty");
+
+  // Everything is copied out of R first, as the workers must not touch R objects
+  std::vector<Drawing_MeasureRequest> requests(n);
+  for (R_xlen_t idx = 0; idx < n; idx++) {
+    Drawing_MeasureRequest &request = requests[idx];
+    SEXP string = STRING_ELT(text, idx);
+    SEXP fontfamily = STRING_ELT(family, idx % family.size());
+    int face = fontface[idx % fontface.size()];
+    double pointsize = size[idx % size.size()];
+
+    request.missing = (string == NA_STRING) || (face == NA_INTEGER) || ISNAN(pointsize);
+    if (request.missing) continue;
+
+    request.text = Rf_translateCharUTF8(string);
+    std::memset(&request.gc, 0, sizeof(request.gc));
+    if (fontfamily != NA_STRING)
+      std::strncpy(request.gc.fontfamily, Rf_translateCharUTF8(fontfamily), sizeof(request.gc.fontfamily) - 1);
+    request.gc.fontface = face;
+    request.gc.ps = pointsize;
+    request.gc.cex = 1;
+  }
+
+  std::vector<Drawing_TextBounds> bounds(n, Drawing_TextBounds{0, 0, 0, 0});
+  std::atomic<std::size_t> next(0);
+
+  if (threads <= 0) threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  threads = static_cast<int>(std::min<std::size_t>(threads, (requests.size() + Drawing_MeasureBlockSize - 1) / Drawing_MeasureBlockSize));
+
+  std::vector<std::unique_ptr<PlatformDeviceDriver>> measurers;
+  for (int idx = 1; idx < threads; idx++) {
+    std::unique_ptr<PlatformDeviceDriver> measurer = NewPlatformTextMeasurer();
+    if (measurer == nullptr) break;
+    measurers.push_back(std::move(measurer));
+  }
+
+  // The calling thread takes blocks too, with the faces the devices share
+  std::unique_ptr<PlatformDeviceDriver> driver = NewPlatformDeviceDriver();
+  std::vector<std::exception_ptr> failures(measurers.size());
+  std::vector<std::thread> workers;
+
+  for (std::size_t idx = 0; idx < measurers.size(); idx++) {
+    workers.emplace_back([&, idx]() {
+      try {
+        Drawing_MeasureBlocks(*measurers[idx], requests, bounds, next);
+      }
+
+      catch (...) {
+        failures[idx] = std::current_exception();
+      }
+    });
+  }
+
+  std::exception_ptr failure;
+  try {
+    Drawing_MeasureBlocks(*driver, requests, bounds, next);
+  }
+
+  catch (...) {
+    failure = std::current_exception();
+  }
+
+  for (auto &worker : workers)
+    worker.join();
+
+  for (auto &worker_failure : failures)
+    if (!failure) failure = worker_failure;
+  if (failure) std::rethrow_exception(failure);
+
+  Rcpp::NumericMatrix metrics(n, 3);
+  for (R_xlen_t idx = 0; idx < n; idx++) {
+    if (requests[idx].missing) {
+      metrics(idx, 0) = metrics(idx, 1) = metrics(idx, 2) = NA_REAL;
+      continue;
+    }
+
+    metrics(idx, 0) = bounds[idx].width;
+    metrics(idx, 1) = bounds[idx].ascent;
+    metrics(idx, 2) = -bounds[idx].descent;
+  }
+
+  Rcpp::colnames(metrics) = Rcpp::CharacterVector::create("width", "ascent", "descent");
+  return metrics;
+}
@@ -0,0 +1,69 @@
+#include "text_scan.h"
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define DRAWING_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// Eight bytes at a time, for the tail and for other architectures
+static bool Drawing_IsASCII_scalar(const char *data, std::size_t size) {
+  std::size_t idx = 0;
+
+  for (; idx + 8 <= size; idx += 8) {
+    uint64_t word;
+    std::memcpy(&word, data + idx, sizeof(word));
+    if (word & 0x8080808080808080ULL) return false;
+  }
+
+  for (; idx < size; idx++)
+    if (static_cast<uint8_t>(data[idx]) & 0x80) return false;
+
+  return true;
+}
+
+#ifdef DRAWING_SCAN_X86
+__attribute__((target("sse2")))
+static bool Drawing_IsASCII_sse2(const char *data, std::size_t size) {
+  std::size_t idx = 0;
+
+  for (; idx + 16 <= size; idx += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + idx));
+    if (_mm_movemask_epi8(chunk) != 0) return false;
+  }
+
+  return Drawing_IsASCII_scalar(data + idx, size - idx);
+}
+
+__attribute__((target("avx2")))
+static bool Drawing_IsASCII_avx2(const char *data, std::size_t size) {
+  std::size_t idx = 0;
+
+  for (; idx + 32 <= size; idx += 32) {
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + idx));
+    if (_mm256_movemask_epi8(chunk) != 0) return false;
+  }
+
+  return Drawing_IsASCII_sse2(data + idx, size - idx);
+}
+#endif
+
+typedef bool (*Drawing_IsASCII_function)(const char *, std::size_t);
+
+// Picked once, from what the CPU running the package supports
+static Drawing_IsASCII_function Drawing_IsASCII_select() {
+#ifdef DRAWING_SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return Drawing_IsASCII_avx2;
+  if (__builtin_cpu_supports("sse2")) return Drawing_IsASCII_sse2;
+#endif
+  return Drawing_IsASCII_scalar;
+}
+
+bool Drawing_IsASCII(const char *data, std::size_t size) {
+  // Labels are short; the vector set up isn't worth it
+  if (size < 16) return Drawing_IsASCII_scalar(data, size);
+
+  static const Drawing_IsASCII_function scan = Drawing_IsASCII_select();
+  return scan(data, size);
+}
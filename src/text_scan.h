@@ -0,0 +1,45 @@
+// Text scanning shared by text measurement and XML escaping. Pure ASCII strings
+// are detected with a vectorised pass so callers can index bytes directly;
+// anything else goes through a validating UTF-8 decoder that reports invalid
+// input instead of throwing.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// True when every byte is below 0x80
+bool Drawing_IsASCII(const char *data, std::size_t size);
+
+// Decodes the codepoint at pos and advances past it. Returns false, leaving pos
+// unchanged, for malformed, overlong, surrogate or out of range sequences.
+inline bool Drawing_NextCodepoint(const char *&pos, const char *end, uint32_t &codepoint) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(pos);
+  const uint8_t *e = reinterpret_cast<const uint8_t *>(end);
+  if (p >= e) return false;
+
+  uint8_t lead = p[0];
+  if (lead < 0x80) {
+    codepoint = lead;
+    pos++;
+    return true;
+  }
+
+  std::size_t length;
+  uint32_t minimum;
+  if ((lead & 0xE0) == 0xC0) { length = 2; minimum = 0x80; codepoint = lead & 0x1F; }
+  else if ((lead & 0xF0) == 0xE0) { length = 3; minimum = 0x800; codepoint = lead & 0x0F; }
+  else if ((lead & 0xF8) == 0xF0) { length = 4; minimum = 0x10000; codepoint = lead & 0x07; }
+  else return false;
+
+  if (static_cast<std::size_t>(e - p) < length) return false;
+
+  for (std::size_t idx = 1; idx < length; idx++) {
+    if ((p[idx] & 0xC0) != 0x80) return false;
+    codepoint = (codepoint << 6) | (p[idx] & 0x3F);
+  }
+
+  if ((codepoint < minimum) || (codepoint > 0x10FFFF) || ((codepoint >= 0xD800) && (codepoint <= 0xDFFF)))
+    return false;
+
+  pos += length;
+  return true;
+}
@@ -1,61 +1,539 @@
 #include <Rcpp.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include FT_ADVANCES_H
 #include <fontconfig/fontconfig.h>
 #include <cmath>
+#include <list>
+#include <array>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <algorithm>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#ifdef DRAWING_HARFBUZZ
+#include <hb.h>
+#include <hb-ft.h>
+#endif
 #include "../platform_specific.h"
-#define UTF_CPP_CPLUSPLUS 201703L
-#include "../utf8.h"
+#include "../text_scan.h"
+#include "../binary_io.h"
+#include "../mapped_file.h"
+#include "../recorder.h"
 
 struct FontDetails {
   std::string fontfamily;
   std::string name;
   std::string style;
   std::string file;
+  int index;           // of the face in a font collection
   bool bold;
   bool italic;
 
   FontDetails() {
+    index = 0;
     bold = false;
     italic = false;
   }
+
+  // Identifies the face, as a collection file holds several
+  std::string face() const { return file + '#' + std::to_string(index); }
 };
 
-struct UnixDeviceDriver: PlatformDeviceDriver {
-  FT_Library library;
-  FT_Face face;
+// Most recently used faces are kept open, so alternating fonts don't reload them
+const std::size_t UnixFaceCacheSize = 16;
+// Shaped widths kept per face set, by font and text
+const std::size_t UnixShapedCacheSize = 4096;
+
+const uint32_t UnixCodepointPageSize = 256;
+const uint32_t UnixCodepointPages = 0x110000 / UnixCodepointPageSize;
+
+// Table values for a codepoint not looked at yet, and for one the font has no glyph for
+const int32_t UnixCodepointUnknown = -1;
+const int32_t UnixGlyphMissing = -2;
+
+// A value per codepoint, UnixCodepointUnknown until set. Any thread may read or set a
+// value without locking: pages are allocated on first use and published with a
+// compare-and-swap, and a value once set never changes.
+class UnixCodepointTable {
+  typedef std::array<std::atomic<int32_t>, UnixCodepointPageSize> Page;
+  std::unique_ptr<std::atomic<Page *>[]> pages;
+
+  public:
+  UnixCodepointTable();
+  ~UnixCodepointTable();
+  UnixCodepointTable(const UnixCodepointTable&) = delete;
+  UnixCodepointTable& operator=(const UnixCodepointTable&) = delete;
+
+  int32_t get(uint32_t charcode) const;
+  // Anything written before set() is visible to a thread that get()s the value
+  void set(uint32_t charcode, int32_t value);
+
+  // Calls fn(charcode, value) for every value set, in codepoint order
+  template <class Function> void forEach(Function fn) const {
+    for (uint32_t page = 0; page < UnixCodepointPages; page++) {
+      const Page *values = pages[page].load(std::memory_order_acquire);
+      if (values == nullptr) continue;
+
+      for (uint32_t idx = 0; idx < UnixCodepointPageSize; idx++) {
+        int32_t value = (*values)[idx].load(std::memory_order_acquire);
+        if (value != UnixCodepointUnknown) fn(page * UnixCodepointPageSize + idx, value);
+      }
+    }
+  }
+};
+
+struct UnixFont;
+
+// A font fontconfig offers for codepoints the requested one lacks
+struct UnixFallback {
   FontDetails details;
+  FcCharSet *charset;
+  UnixFont *font;      // loaded when it is first needed
+};
+
+// A requested family and style, and the font file it resolved to. Every field but the
+// tables and the fallbacks is fixed before the font is shared, so any thread may read it.
+struct UnixFont {
+  std::string family;  // as requested
+  bool bold;
+  bool italic;
+  FontDetails details; // file is empty when no font matched
+  int64_t mtime;       // of details.file, to validate the metrics cache
+  uint64_t size;
+
+  bool loaded;         // metrics below are known, from the font file or the metrics cache
+  int ascender;
+  int descender;
+  int units_per_EM;
+  int notdef;          // advance of the missing glyph
+  UnixCodepointTable advances;  // unscaled, in font units, or UnixGlyphMissing
+  std::atomic<bool> dirty;      // measured since the metrics cache was read
+
+  // Fonts to measure missing glyphs from, best first; the chain is looked up once, under
+  // the service lock. coverage holds the index of the fallback used for each codepoint.
+  bool fallbacksResolved;
+  std::vector<UnixFallback> fallbacks;
+  UnixCodepointTable coverage;
+
+  UnixFont() {
+    bold = italic = false;
+    mtime = 0;
+    size = 0;
+    loaded = false;
+    ascender = descender = units_per_EM = notdef = 0;
+    dirty = false;
+    fallbacksResolved = false;
+  }
+
+  ~UnixFont() {
+    for (auto& fallback : fallbacks)
+      FcCharSetDestroy(fallback.charset);
+  }
+};
+
+// Font files mapped read-only once per process. Faces are opened from memory, so every
+// face of a file, in any face set or device, shares one mapping instead of FreeType
+// opening a stream per face. A file is unmapped once its last face is closed.
+class UnixFontFiles {
+  std::mutex lock;
+  std::unordered_map<std::string, std::weak_ptr<MappedFile>> files;
+
+  public:
+  static UnixFontFiles& instance();
+  // Throws if the file cannot be mapped
+  std::shared_ptr<MappedFile> map(const std::string& path);
+};
+
+struct UnixOpenFace {
+  const UnixFont *font;
+  FT_Face face;
+  std::shared_ptr<MappedFile> file; // must outlive the face
+#ifdef DRAWING_HARFBUZZ
+  hb_font_t *shaper;   // created when text is first shaped in this face
+#endif
+};
+
+// Open FreeType faces for the fonts one thread measures from. FreeType objects must not
+// be used from two threads at once, so every thread that measures has a set of its own.
+class UnixFaceSet {
+  FT_Library library;
+  std::list<UnixOpenFace> faces; // most recently used first
+
+#ifdef DRAWING_HARFBUZZ
+  hb_buffer_t *buffer;
+  // Shaped advances (font units) by font and text, least recently used last
+  typedef std::pair<std::string, double> ShapedEntry;
+  std::list<ShapedEntry> shaped;
+  std::unordered_map<std::string, std::list<ShapedEntry>::iterator> shapedIndex;
+
+  void closeFace(UnixOpenFace& entry);
+#endif
+
+  UnixOpenFace& openEntry(const UnixFont& font);
+
+  public:
+  UnixFaceSet();
+  ~UnixFaceSet();
+  UnixFaceSet(const UnixFaceSet&) = delete;
+  UnixFaceSet& operator=(const UnixFaceSet&) = delete;
+
+  // Throws if the font file fails to load
+  FT_Face open(const UnixFont& font);
+  void close();
+
+#ifdef DRAWING_HARFBUZZ
+  // Advance of the text after shaping, with kerning and ligatures, in font units. Glyphs
+  // the font lacks are measured by missing(codepoint) instead.
+  double ShapedAdvance(const UnixFont& font, const std::string& text, const bool UTF8,
+                       const std::function<double(uint32_t)>& missing);
+#endif
+};
+
+typedef std::tuple<std::string, bool, bool> UnixFontRequest; // family, bold, italic
+
+// Font metrics kept on disk between sessions. The file is mapped read-only when the
+// device opens; each record holds the metrics and advances of one font face, and is
+// ignored once that file's modification time or size changes. Records measured in
+// this session are written back, through a temporary file and rename, on close.
+// The file also holds the font each requested family and style resolved to, so a
+// later session can skip fontconfig; these are dropped once the fingerprint of the
+// fontconfig configuration and caches changes.
+class UnixMetricsCache {
+  std::string path;
+  std::unique_ptr<MappedFile> file;
+  std::unordered_map<std::string, std::pair<const uint8_t *, std::size_t>> records; // by font face
+  std::map<UnixFontRequest, FontDetails> resolutions;
+  bool resolutionsDirty;
+
+  public:
+  UnixMetricsCache() : resolutionsDirty(false) {}
+
+  void open(const std::string& path);
+  const std::string& location() const { return path; }
+  bool restore(UnixFont& font) const;
+  // Font a request resolved to in an earlier session; an empty file if none matched
+  bool resolve(const UnixFontRequest& request, FontDetails& details) const;
+  void resolved(const UnixFontRequest& request, const FontDetails& details);
+  void save(const std::vector<std::unique_ptr<UnixFont>>& fonts);
+};
+
+// Resolved fonts and their metrics, shared by every device and text measurer in the
+// process so that opening a device per plot does not load the same fonts again. The
+// service lives until the package is unloaded and is safe to use from any thread:
+// resolving a font takes a lock, reading its advances does not. Devices, which all run
+// on the R thread, share one set of open faces; once the last UnixFontHandle is
+// released those files are closed, but everything measured from them is kept.
+class UnixFontService {
+  std::mutex lock;
+  std::vector<std::unique_ptr<UnixFont>> fonts; // never removed
+  std::map<UnixFontRequest, UnixFont *> requested;
+  std::unordered_map<std::string, UnixFont *> fallbackFonts; // by font face
+  UnixMetricsCache metricsCache;
+  UnixFaceSet deviceFaces;
+  std::atomic<std::size_t> handles;
+
+  UnixFontService();
+  void LoadMetrics(UnixFont& font, UnixFaceSet& faces);
+  int32_t GlyphAdvance(UnixFont& font, uint32_t charcode, UnixFaceSet& faces);
+  UnixFont *Fallback(UnixFont& font, uint32_t charcode, UnixFaceSet& faces);
+
+  public:
+  UnixFontService(const UnixFontService&) = delete;
+  UnixFontService& operator=(const UnixFontService&) = delete;
+
+  static UnixFontService& instance();
+  void acquire();
+  void release();
+  UnixFaceSet& sharedFaces() { return deviceFaces; }
+
+  // Null if no font matched; faces is used to read the metrics of a font not seen before
+  UnixFont *LoadFont(const std::string& family, const bool bold, const bool italic, UnixFaceSet& faces);
+  // In the font's units; a glyph the font lacks is measured from a fallback font and scaled
+  double Advance(UnixFont& font, uint32_t charcode, UnixFaceSet& faces);
+  double MissingAdvance(UnixFont& font, uint32_t charcode, UnixFaceSet& faces);
+
+  // The metrics cache is process-wide, and one file is open at a time: the one given to
+  // the most recently opened device. Opening another file saves the current one first.
+  // Saving only writes path while it is still the open file, and only if anything changed.
+  void OpenMetricsCache(const std::string& path);
+  void SaveMetricsCache(const std::string& path);
+
+  // UnixFontConfigFingerprint(), read under the lock like every other use of fontconfig
+  std::string FontConfigFingerprint();
+};
+
+// A driver's reference to the shared font service
+class UnixFontHandle {
+  UnixFontService& service;
+
+  public:
+  UnixFontHandle(UnixFontService& service) : service(service) { service.acquire(); }
+  ~UnixFontHandle() { service.release(); }
+  UnixFontHandle(const UnixFontHandle&) = delete;
+  UnixFontHandle& operator=(const UnixFontHandle&) = delete;
+
+  UnixFontService& operator*() const { return service; }
+  UnixFontService *operator->() const { return &service; }
+};
+
+struct UnixDeviceDriver: PlatformDeviceDriver {
+  UnixFontHandle fonts;
+  std::unique_ptr<UnixFaceSet> owned; // set for text measurers on worker threads
+  UnixFaceSet& faces;
+  UnixFont *last;                     // most recently measured font, found without locking
+  std::thread warmer;
+  std::string metricsCachePath;       // the metrics cache this device opened, saved on close
 
   public:
-  UnixDeviceDriver();
+  UnixDeviceDriver() : fonts(UnixFontService::instance()), faces(fonts->sharedFaces()), last(nullptr) {}
+  UnixDeviceDriver(std::unique_ptr<UnixFaceSet> own) :
+    fonts(UnixFontService::instance()), owned(std::move(own)), faces(*owned), last(nullptr) {}
   virtual ~UnixDeviceDriver();
 
   virtual std::string PlatformFontFamily(const pGEcontext gc) const;
   virtual bool PlatformTextBoundingRect(const std::string& family, const bool bold, const bool italic, const double pointsize,
                                         const std::string& text, const bool UTF8, const bool symbol,
                                         Drawing_TextBounds& bounds);
-  private:
-  void LoadFont(const std::string& family, const bool bold, const bool italic);
-
+  virtual void OpenMetricsCache(const std::string& path);
+  virtual void SaveMetricsCache();
+  virtual std::string MetricsFingerprint();
+  virtual void WarmUp(const std::string& family);
 };
 
 std::unique_ptr<PlatformDeviceDriver> NewPlatformDeviceDriver() {
   return std::make_unique<UnixDeviceDriver>();
 }
 
-UnixDeviceDriver::UnixDeviceDriver() {
+std::unique_ptr<PlatformDeviceDriver> NewPlatformTextMeasurer() {
+  return std::make_unique<UnixDeviceDriver>(std::make_unique<UnixFaceSet>());
+}
+
+UnixCodepointTable::UnixCodepointTable() : pages(new std::atomic<Page *>[UnixCodepointPages]) {
+  for (uint32_t page = 0; page < UnixCodepointPages; page++)
+    pages[page].store(nullptr, std::memory_order_relaxed);
+}
+
+UnixCodepointTable::~UnixCodepointTable() {
+  for (uint32_t page = 0; page < UnixCodepointPages; page++)
+    delete pages[page].load(std::memory_order_relaxed);
+}
+
+int32_t UnixCodepointTable::get(uint32_t charcode) const {
+  if (charcode >= UnixCodepointPages * UnixCodepointPageSize) return UnixCodepointUnknown;
+
+  const Page *values = pages[charcode / UnixCodepointPageSize].load(std::memory_order_acquire);
+  if (values == nullptr) return UnixCodepointUnknown;
+  return (*values)[charcode % UnixCodepointPageSize].load(std::memory_order_acquire);
+}
+
+void UnixCodepointTable::set(uint32_t charcode, int32_t value) {
+  if (charcode >= UnixCodepointPages * UnixCodepointPageSize) return;
+
+  std::atomic<Page *>& slot = pages[charcode / UnixCodepointPageSize];
+  Page *values = slot.load(std::memory_order_acquire);
+
+  if (values == nullptr) {
+    Page *created = new Page;
+    for (auto& unknown : *created)
+      unknown.store(UnixCodepointUnknown, std::memory_order_relaxed);
+
+    // Another thread may have added the page first; its page is used instead
+    if (slot.compare_exchange_strong(values, created, std::memory_order_acq_rel, std::memory_order_acquire))
+      values = created;
+    else
+      delete created;
+  }
+
+  // Threads setting the same codepoint store the same value
+  (*values)[charcode % UnixCodepointPageSize].store(value, std::memory_order_release);
+}
+
+UnixFontFiles& UnixFontFiles::instance() {
+  static UnixFontFiles registry;
+  return registry;
+}
+
+std::shared_ptr<MappedFile> UnixFontFiles::map(const std::string& path) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  std::weak_ptr<MappedFile>& entry = files[path];
+  std::shared_ptr<MappedFile> mapped = entry.lock();
+  if (mapped) return mapped;
+
+  mapped = std::make_shared<MappedFile>(path);
+  entry = mapped;
+  return mapped;
+}
+
+UnixFaceSet::UnixFaceSet() {
   library = nullptr;
-  face = nullptr;
 
   if (FT_Init_FreeType(&library) != FT_Err_Ok)
     throw std::runtime_error("Failed to initialise FreeType library");
+
+#ifdef DRAWING_HARFBUZZ
+  buffer = hb_buffer_create();
+#endif
 }
 
-UnixDeviceDriver::~UnixDeviceDriver() {
-  if (face) FT_Done_Face(face);
+UnixFaceSet::~UnixFaceSet() {
+  close();
+#ifdef DRAWING_HARFBUZZ
+  hb_buffer_destroy(buffer);
+#endif
   if (library) FT_Done_FreeType(library);
 }
 
+UnixOpenFace& UnixFaceSet::openEntry(const UnixFont& font) {
+  for (auto it = faces.begin(); it != faces.end(); ++it) {
+    if (it->font == &font) {
+      faces.splice(faces.begin(), faces, it);
+      return *it;
+    }
+  }
+
+  UnixOpenFace entry{};
+  entry.font = &font;
+  entry.file = UnixFontFiles::instance().map(font.details.file);
+  if (FT_New_Memory_Face(library, entry.file->data(), static_cast<FT_Long>(entry.file->size()),
+                         font.details.index, &entry.face) != FT_Err_Ok)
+    throw std::runtime_error("Failed to load font");
+
+  if (faces.size() >= UnixFaceCacheSize) {
+#ifdef DRAWING_HARFBUZZ
+    closeFace(faces.back());
+#else
+    FT_Done_Face(faces.back().face);
+#endif
+    faces.pop_back();
+  }
+
+  faces.push_front(std::move(entry));
+  return faces.front();
+}
+
+FT_Face UnixFaceSet::open(const UnixFont& font) {
+  return openEntry(font).face;
+}
+
+void UnixFaceSet::close() {
+  for (auto& entry : faces) {
+#ifdef DRAWING_HARFBUZZ
+    closeFace(entry);
+#else
+    FT_Done_Face(entry.face);
+#endif
+  }
+  faces.clear();
+}
+
+#ifdef DRAWING_HARFBUZZ
+void UnixFaceSet::closeFace(UnixOpenFace& entry) {
+  // The shaper holds a reference to the face, so it goes first
+  if (entry.shaper) hb_font_destroy(entry.shaper);
+  FT_Done_Face(entry.face);
+}
+
+double UnixFaceSet::ShapedAdvance(const UnixFont& font, const std::string& text, const bool UTF8,
+                                  const std::function<double(uint32_t)>& missing) {
+  // Widths in font units do not depend on the point size, so the key is font and text only
+  const UnixFont *address = &font;
+  std::string key;
+  key.reserve(sizeof(address) + 1 + text.size());
+  key.append(reinterpret_cast<const char *>(&address), sizeof(address));
+  key.push_back(static_cast<char>(UTF8));
+  key.append(text);
+
+  auto found = shapedIndex.find(key);
+  if (found != shapedIndex.end()) {
+    shaped.splice(shaped.begin(), shaped, found->second);
+    return found->second->second;
+  }
+
+  UnixOpenFace& entry = openEntry(font);
+  if (entry.shaper == nullptr) {
+    // HarfBuzz's own OpenType functions read GPOS kerning, and leave the scale at units per EM
+    hb_face_t *face = hb_ft_face_create_referenced(entry.face);
+    entry.shaper = hb_font_create(face);
+    hb_face_destroy(face);
+  }
+
+  // As without HarfBuzz, measurement stops at the first invalid sequence, rather than
+  // HarfBuzz replacing it with U+FFFD
+  std::size_t length = text.size();
+  if (UTF8 && !Drawing_IsASCII(text.data(), text.size())) {
+    const char *pos = text.data();
+    const char *end = pos + text.size();
+    uint32_t charcode;
+
+    while (Drawing_NextCodepoint(pos, end, charcode)) {}
+    length = static_cast<std::size_t>(pos - text.data());
+  }
+
+  hb_buffer_clear_contents(buffer);
+  if (UTF8)
+    hb_buffer_add_utf8(buffer, text.data(), static_cast<int>(length), 0, static_cast<int>(length));
+  else
+    hb_buffer_add_latin1(buffer, reinterpret_cast<const uint8_t *>(text.data()), static_cast<int>(text.size()),
+                         0, static_cast<int>(text.size()));
+  hb_buffer_guess_segment_properties(buffer);
+  hb_shape(entry.shaper, buffer, nullptr, 0);
+
+  unsigned int count = 0;
+  const hb_glyph_info_t *glyphs = hb_buffer_get_glyph_infos(buffer, &count);
+  const hb_glyph_position_t *positions = hb_buffer_get_glyph_positions(buffer, &count);
+
+  double total_advance = 0;
+  for (unsigned int idx = 0; idx < count; idx++) {
+    if (glyphs[idx].codepoint != 0) {
+      total_advance += positions[idx].x_advance;
+      continue;
+    }
+
+    // After shaping codepoint is the glyph index, and cluster the offset of the character in text
+    uint32_t charcode = static_cast<uint8_t>(text[glyphs[idx].cluster]);
+    const char *pos = text.data() + glyphs[idx].cluster;
+    if (UTF8) Drawing_NextCodepoint(pos, text.data() + length, charcode);
+    total_advance += missing(charcode);
+  }
+
+  if (shaped.size() >= UnixShapedCacheSize) {
+    shapedIndex.erase(shaped.back().first);
+    shaped.pop_back();
+  }
+
+  shaped.emplace_front(key, total_advance);
+  shapedIndex.emplace(std::move(key), shaped.begin());
+
+  return total_advance;
+}
+#endif
+
+UnixFontService::UnixFontService() {
+  handles = 0;
+}
+
+UnixFontService& UnixFontService::instance() {
+  // A failed initialisation throws, and is tried again by the next device
+  static UnixFontService service;
+  return service;
+}
+
+void UnixFontService::acquire() {
+  handles++;
+}
+
+void UnixFontService::release() {
+  if (--handles == 0) deviceFaces.close();
+}
+
 std::string UnixDeviceDriver::PlatformFontFamily(const pGEcontext gc) const {
   if (gc == NULL) return "Arial";
 
@@ -75,100 +553,625 @@ std::string UnixDeviceDriver::PlatformFontFamily(const pGEcontext gc) const {
 }
 
 
-void UnixDeviceDriver::LoadFont(const std::string& family, const bool bold, const bool italic) {
-  // Check if font face is already loaded
-  if ((family == details.fontfamily) && (bold == details.bold) && (italic == details.italic) && (face)) return;
+// The configuration is loaded once per process. Loading the font list is the expensive
+// part, so it waits until a font has to be matched. Both steps run exactly once, even
+// when several threads ask at the same time.
+static FcConfig *UnixFontConfig(const bool fonts = true) {
+  static FcConfig *config = FcInitLoadConfig();
+  static std::once_flag built;
 
-  // Remove old face if its set
-  if (face) FT_Done_Face(face);
-  face = nullptr;
+  if (fonts) std::call_once(built, []() { FcConfigBuildFonts(config); });
 
-  // Use FontConfig to find match
-  FcInit();
-  FcConfig *config = FcInitLoadConfigAndFonts();
+  return config;
+}
+
+static void UnixFingerprintFile(Drawing_StreamHash& hash, const std::string& path) {
+  struct stat info;
+  int64_t stamp[2] = {0, 0};
+  if (stat(path.c_str(), &info) == 0) {
+    stamp[0] = static_cast<int64_t>(info.st_mtime);
+    stamp[1] = static_cast<int64_t>(info.st_size);
+  }
+
+  hash.update(path.c_str(), path.size() + 1);
+  hash.update(reinterpret_cast<const char *>(stamp), sizeof(stamp));
+}
+
+// Changes whenever fontconfig could match differently: a new fontconfig version, an
+// edited configuration file, or fonts added or removed, which touches the font
+// directories and rewrites fontconfig's caches. Computed once per process, without
+// loading the font list. It reads the shared configuration, so it is only called with
+// the font service lock held.
+static std::string UnixComputeFontConfigFingerprint() {
+  FcConfig *config = UnixFontConfig(false);
+  Drawing_StreamHash hash;
+  int version = FcGetVersion();
+  hash.update(reinterpret_cast<const char *>(&version), sizeof(version));
+
+  FcStrList *files = FcConfigGetConfigFiles(config);
+  for (FcChar8 *name; files && (name = FcStrListNext(files));)
+    UnixFingerprintFile(hash, reinterpret_cast<const char *>(name));
+  if (files) FcStrListDone(files);
+
+  FcStrList *dirs = FcConfigGetFontDirs(config);
+  for (FcChar8 *name; dirs && (name = FcStrListNext(dirs));)
+    UnixFingerprintFile(hash, reinterpret_cast<const char *>(name));
+  if (dirs) FcStrListDone(dirs);
+
+  FcStrList *caches = FcConfigGetCacheDirs(config);
+  for (FcChar8 *name; caches && (name = FcStrListNext(caches));) {
+    std::string dir(reinterpret_cast<const char *>(name));
+    std::vector<std::string> entries;
+
+    if (DIR *listing = opendir(dir.c_str())) {
+      while (struct dirent *entry = readdir(listing))
+        if (entry->d_name[0] != '.') entries.push_back(dir + "/" + entry->d_name);
+      closedir(listing);
+    }
+
+    std::sort(entries.begin(), entries.end());
+    for (const auto& entry : entries)
+      UnixFingerprintFile(hash, entry);
+  }
+  if (caches) FcStrListDone(caches);
+
+  return hash.str();
+}
+
+static const std::string& UnixFontConfigFingerprint() {
+  static const std::string fingerprint = UnixComputeFontConfigFingerprint();
+  return fingerprint;
+}
+
+// Pattern for a family and style, ready for matching
+static FcPattern *UnixFontPattern(FcConfig *config, const std::string& family, const bool bold, const bool italic) {
   FcPattern *pattern = FcPatternCreate();
   FcPatternAddString(pattern, FC_FAMILY, (FcChar8 *)family.c_str());
   if (bold) FcPatternAddInteger(pattern, FC_WEIGHT, FC_WEIGHT_BOLD);
   if (italic) FcPatternAddInteger(pattern, FC_SLANT, FC_SLANT_ITALIC);
   FcConfigSubstitute(config, pattern, FcMatchPattern);
   FcDefaultSubstitute(pattern);
+  return pattern;
+}
 
-  FcResult result;
-  FcPattern *font = FcFontMatch(config, pattern, &result);
-  if (font) {
-    FcChar8 *file, *fontfamily, *style, *name;
-    if (FcPatternGetString(font, FC_FILE, 0, &file) == FcResultMatch &&
-        FcPatternGetString(font, FC_FAMILY, 0, &fontfamily) == FcResultMatch &&
-        FcPatternGetString(font, FC_STYLE, 0, &style) == FcResultMatch &&
-        FcPatternGetString(font, FC_FULLNAME, 0, &name) == FcResultMatch) {
-      details.file.assign((char *)file);
-      details.fontfamily.assign((char *)fontfamily);
-      details.bold = bold;
-      details.italic = italic;
-      details.name.assign((char *)name);
-
-      if (FT_New_Face(library, (char *)file, 0, &face) != FT_Err_Ok) {
-        face = nullptr;
-        throw std::runtime_error("Failed to load font");
-      }
+// Details of a matched font; false if it lacks any of them
+static bool UnixFontDetails(FcPattern *match, const bool bold, const bool italic, FontDetails& details) {
+  FcChar8 *file, *fontfamily, *style, *name;
+  if (FcPatternGetString(match, FC_FILE, 0, &file) != FcResultMatch ||
+      FcPatternGetString(match, FC_FAMILY, 0, &fontfamily) != FcResultMatch ||
+      FcPatternGetString(match, FC_STYLE, 0, &style) != FcResultMatch ||
+      FcPatternGetString(match, FC_FULLNAME, 0, &name) != FcResultMatch) return false;
+
+  int index;
+  if (FcPatternGetInteger(match, FC_INDEX, 0, &index) != FcResultMatch) index = 0;
+
+  details.file.assign((char *)file);
+  details.index = index;
+  details.fontfamily.assign((char *)fontfamily);
+  details.style.assign((char *)style);
+  details.bold = bold;
+  details.italic = italic;
+  details.name.assign((char *)name);
+  return true;
+}
+
+UnixFont *UnixFontService::LoadFont(const std::string& family, const bool bold, const bool italic, UnixFaceSet& faces) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  // Check if the font is already resolved
+  UnixFontRequest request(family, bold, italic);
+  auto found = requested.find(request);
+  if (found != requested.end())
+    return found->second->details.file.empty() ? nullptr : found->second;
+
+  std::unique_ptr<UnixFont> font(new UnixFont());
+  font->family = family;
+  font->bold = bold;
+  font->italic = italic;
+
+  // Use FontConfig to find match, unless an earlier session already did
+  if (!metricsCache.resolve(request, font->details)) {
+    FcConfig *config = UnixFontConfig();
+    FcPattern *pattern = UnixFontPattern(config, family, bold, italic);
+
+    FcResult result;
+    FcPattern *match = FcFontMatch(config, pattern, &result);
+    if (match) {
+      if (!UnixFontDetails(match, bold, italic, font->details)) font->details = FontDetails();
+      FcPatternDestroy(match);
     }
+
+    FcPatternDestroy(pattern);
+    metricsCache.resolved(request, font->details);
   }
 
-  FcPatternDestroy(font);
-  FcPatternDestroy(pattern);
-  FcConfigDestroy(config);
-  FcFini();
+  if (!font->details.file.empty()) LoadMetrics(*font, faces);
+
+  // Unmatched requests are cached too, so they are not looked up again
+  UnixFont *resolved = font.get();
+  requested.emplace(request, resolved);
+  fonts.push_back(std::move(font));
+  return resolved->details.file.empty() ? nullptr : resolved;
 }
 
-bool UnixDeviceDriver::PlatformTextBoundingRect(const std::string& family, const bool bold, const bool italic, const double pointsize,
-                                                const std::string& text, const bool UTF8, const bool symbol,
-                                                Drawing_TextBounds& bounds) {
+void UnixFontService::LoadMetrics(UnixFont& font, UnixFaceSet& faces) {
+  struct stat info;
+  if (stat(font.details.file.c_str(), &info) == 0) {
+    font.mtime = static_cast<int64_t>(info.st_mtime);
+    font.size = static_cast<uint64_t>(info.st_size);
+  }
 
-  bounds.ascent = bounds.descent = bounds.width = bounds.height = 0;
+  // Without cached metrics they are read now, before other threads can see the font.
+  // A font that fails to load stays unloaded and is not tried again.
+  if (metricsCache.restore(font)) return;
 
   try {
-    LoadFont(family, bold, italic);
+    FT_Face face = faces.open(font);
+    FT_Fixed unscaled;
+    font.ascender = face->ascender;
+    font.descender = face->descender;
+    font.units_per_EM = face->units_per_EM;
+    font.notdef = (FT_Get_Advance(face, 0, FT_LOAD_NO_SCALE, &unscaled) == FT_Err_Ok) ? static_cast<int>(unscaled) : 0;
+    font.loaded = true;
+    font.dirty = true;
   }
 
   catch (std::exception& e) {
-    return false;
+
   }
+}
 
-  if (face == nullptr) return false;
+int32_t UnixFontService::GlyphAdvance(UnixFont& font, uint32_t charcode, UnixFaceSet& faces) {
+  int32_t advance = font.advances.get(charcode);
+  if (advance != UnixCodepointUnknown) return advance;
 
-  // Set DPI = 72 => pixels = pointsize
-  FT_Set_Char_Size(face, 0, std::floor(pointsize * 64 + 0.5), 72, 72);
+  FT_Face face = faces.open(font);
+  FT_UInt glyph = FT_Get_Char_Index(face, charcode);
 
-  std::string::const_iterator b = text.begin();
-  std::string::const_iterator e = text.end();
-  double total_advance = 0;
-  int glyph_index;
+  FT_Fixed unscaled;
+  if (glyph == 0)
+    advance = UnixGlyphMissing;
+  else if (FT_Get_Advance(face, glyph, FT_LOAD_NO_SCALE, &unscaled) == FT_Err_Ok)
+    advance = static_cast<int32_t>(unscaled);
+  else
+    advance = 0;
 
-  while (b != e) {
-    uint32_t charcode;
+  font.advances.set(charcode, advance);
+  font.dirty = true;
+  return advance;
+}
+
+double UnixFontService::Advance(UnixFont& font, uint32_t charcode, UnixFaceSet& faces) {
+  int32_t advance = GlyphAdvance(font, charcode, faces);
+  if (advance != UnixGlyphMissing) return advance;
+
+  return MissingAdvance(font, charcode, faces);
+}
+
+double UnixFontService::MissingAdvance(UnixFont& font, uint32_t charcode, UnixFaceSet& faces) {
+  UnixFont *fallback = Fallback(font, charcode, faces);
+  if (fallback == nullptr) return font.notdef;
+
+  int32_t advance = GlyphAdvance(*fallback, charcode, faces);
+  if (advance == UnixGlyphMissing) return font.notdef;
+
+  return static_cast<double>(advance) * font.units_per_EM / fallback->units_per_EM;
+}
+
+UnixFont *UnixFontService::Fallback(UnixFont& font, uint32_t charcode, UnixFaceSet& faces) {
+  int32_t index = font.coverage.get(charcode);
+
+  if (index == UnixCodepointUnknown) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    // fontconfig lists every font in order of preference, with the characters each one
+    // adds, once for the whole family; later codepoints only scan those character sets
+    if (!font.fallbacksResolved) {
+      FcConfig *config = UnixFontConfig();
+      FcPattern *pattern = UnixFontPattern(config, font.family, font.bold, font.italic);
+      FcResult result;
+      FcFontSet *sorted = FcFontSort(config, pattern, FcTrue, nullptr, &result);
+
+      for (int idx = 0; sorted && (idx < sorted->nfont); idx++) {
+        FcPattern *match = FcFontRenderPrepare(config, pattern, sorted->fonts[idx]);
+        UnixFallback fallback{FontDetails(), nullptr, nullptr};
+        FcCharSet *charset;
+
+        if (match && UnixFontDetails(match, font.bold, font.italic, fallback.details) &&
+            (fallback.details.face() != font.details.face()) &&
+            (FcPatternGetCharSet(match, FC_CHARSET, 0, &charset) == FcResultMatch)) {
+          fallback.charset = FcCharSetCopy(charset);
+          font.fallbacks.push_back(std::move(fallback));
+        }
+
+        if (match) FcPatternDestroy(match);
+      }
+
+      if (sorted) FcFontSetDestroy(sorted);
+      FcPatternDestroy(pattern);
+      font.fallbacksResolved = true;
+    }
+
+    index = font.coverage.get(charcode);
+    if (index == UnixCodepointUnknown) {
+      index = UnixGlyphMissing;
+
+      for (std::size_t idx = 0; idx < font.fallbacks.size(); idx++) {
+        UnixFallback& fallback = font.fallbacks[idx];
+        if (!FcCharSetHasChar(fallback.charset, charcode)) continue;
+
+        if (fallback.font == nullptr) {
+          auto loaded = fallbackFonts.find(fallback.details.face());
+          if (loaded == fallbackFonts.end()) {
+            std::unique_ptr<UnixFont> created(new UnixFont());
+            created->family = fallback.details.fontfamily;
+            created->bold = font.bold;
+            created->italic = font.italic;
+            created->details = fallback.details;
+            LoadMetrics(*created, faces);
+
+            loaded = fallbackFonts.emplace(fallback.details.face(), created.get()).first;
+            fonts.push_back(std::move(created));
+          }
+
+          fallback.font = loaded->second;
+        }
+
+        if (fallback.font->loaded) {
+          index = static_cast<int32_t>(idx);
+          break;
+        }
+      }
+
+      // The fallback is published by the store, so readers need no lock
+      font.coverage.set(charcode, index);
+    }
+  }
+
+  if (index == UnixGlyphMissing) return nullptr;
+  return font.fallbacks[index].font;
+}
+
+void UnixFontService::OpenMetricsCache(const std::string& path) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  // Reopening the same file would drop resolutions not yet saved to it
+  if (metricsCache.location() == path) return;
+
+  metricsCache.save(fonts);
+  metricsCache.open(path);
+}
+
+void UnixFontService::SaveMetricsCache(const std::string& path) {
+  std::lock_guard<std::mutex> guard(lock);
+  if (metricsCache.location() != path) return;
+
+  metricsCache.save(fonts);
+}
+
+void UnixDeviceDriver::OpenMetricsCache(const std::string& path) {
+  metricsCachePath = path;
+  fonts->OpenMetricsCache(path);
+}
+
+void UnixDeviceDriver::SaveMetricsCache() {
+  if (metricsCachePath.empty()) return;
+  fonts->SaveMetricsCache(metricsCachePath);
+}
+
+std::string UnixFontService::FontConfigFingerprint() {
+  std::lock_guard<std::mutex> guard(lock);
+  return UnixFontConfigFingerprint();
+}
+
+std::string UnixDeviceDriver::MetricsFingerprint() {
+#ifdef DRAWING_HARFBUZZ
+  return fonts->FontConfigFingerprint() + " harfbuzz " + hb_version_string();
+#else
+  return fonts->FontConfigFingerprint();
+#endif
+}
+
+void UnixDeviceDriver::WarmUp(const std::string& family) {
+  if (warmer.joinable()) return;
+
+  // Resolving the fonts also loads fontconfig's font list. The thread has faces of its
+  // own, and only leaves resolved fonts and ASCII advances behind in the service.
+  UnixFontService& service = *fonts;
+  warmer = std::thread([&service, family]() {
     try {
-      if (UTF8) {
-        charcode = utf8::next(b, e);
-      } else {
-        charcode = static_cast<uint8_t>(*b);
-        b++;
+      UnixFaceSet faces;
+
+      for (int style = 0; style < 4; style++) {
+        UnixFont *font = service.LoadFont(family, (style & 1) != 0, (style & 2) != 0, faces);
+        if ((font == nullptr) || !font->loaded) continue;
+
+        for (uint32_t charcode = 0x20; charcode < 0x7F; charcode++)
+          service.Advance(*font, charcode, faces);
       }
     }
 
     catch (std::exception& e) {
-      break;
+
+    }
+  });
+}
+
+UnixDeviceDriver::~UnixDeviceDriver() {
+  if (warmer.joinable()) warmer.join();
+}
+
+const uint32_t UnixMetricsCacheMagic = 0x434D4452; // "RDMC"
+// Version 2 added the missing glyph advance, and records glyphs a font lacks. Version 3
+// added font resolutions and the face index.
+const uint64_t UnixMetricsCacheVersion = 3;
+
+void UnixMetricsCache::open(const std::string& path) {
+  this->path = path;
+  records.clear();
+  resolutions.clear();
+  resolutionsDirty = false;
+  file.reset();
+
+  // A missing or unreadable cache is simply rebuilt
+  try {
+    file.reset(new MappedFile(path));
+    Drawing_BinaryReader in(file->data(), file->size());
+    if (file->size() < sizeof(uint32_t) || in.get_u32() != UnixMetricsCacheMagic) return;
+    if (in.get_varint() != UnixMetricsCacheVersion) return;
+
+    bool current = (in.get_string() == UnixFontConfigFingerprint());
+    for (uint64_t count = in.get_varint(); count > 0; count--) {
+      std::string family = in.get_string();
+      uint8_t flags = in.get_u8();
+      FontDetails details;
+      details.file = in.get_string();
+      details.index = static_cast<int>(in.get_varint());
+      details.fontfamily = in.get_string();
+      details.style = in.get_string();
+      details.name = in.get_string();
+      details.bold = (flags & 1) != 0;
+      details.italic = (flags & 2) != 0;
+
+      if (current) resolutions[UnixFontRequest(family, details.bold, details.italic)] = details;
     }
 
-    glyph_index = FT_Get_Char_Index(face, charcode);
-    if (FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT) == FT_Err_Ok) {
-      total_advance += face->glyph->advance.x >> 6; // x units are 1/64ths, need to divide by 64 to convert into pixels
+    while (!in.eof()) {
+      uint64_t length = in.get_varint();
+      if (static_cast<uint64_t>(in.end - in.pos) < length) break;
+
+      Drawing_BinaryReader record(in.pos, length);
+      std::string font_file = record.get_string();
+      std::string face = font_file + '#' + std::to_string(record.get_varint());
+      records[face] = {in.pos, length};
+      in.pos += length;
     }
   }
 
-  bounds.ascent = static_cast<double>(face->ascender) / static_cast<double>(face->units_per_EM) * pointsize;
-  bounds.descent = static_cast<double>(face->descender) / static_cast<double>(face->units_per_EM) * pointsize;
+  catch (std::exception& e) {
+    records.clear();
+    resolutions.clear();
+  }
+}
+
+bool UnixMetricsCache::resolve(const UnixFontRequest& request, FontDetails& details) const {
+  auto found = resolutions.find(request);
+  if (found == resolutions.end()) return false;
+
+  details = found->second;
+  return true;
+}
+
+void UnixMetricsCache::resolved(const UnixFontRequest& request, const FontDetails& details) {
+  if (path.empty()) return;
+
+  resolutions[request] = details;
+  resolutionsDirty = true;
+}
+
+bool UnixMetricsCache::restore(UnixFont& font) const {
+  auto found = records.find(font.details.face());
+  if (found == records.end()) return false;
+
+  std::vector<std::pair<uint32_t, int32_t>> advances;
+  int ascender, descender, units_per_EM, notdef;
+
+  try {
+    Drawing_BinaryReader in(found->second.first, found->second.second);
+    in.get_string();
+    in.get_varint();
+    if (in.get_svarint() != font.mtime) return false;
+    if (in.get_varint() != font.size) return false;
+
+    ascender = static_cast<int>(in.get_svarint());
+    descender = static_cast<int>(in.get_svarint());
+    units_per_EM = static_cast<int>(in.get_varint());
+    notdef = static_cast<int>(in.get_varint());
+
+    // Advances are stored offset so that missing and unknown glyphs are not negative
+    for (uint32_t charcode = 0; charcode < 256; charcode++) {
+      int32_t advance = static_cast<int32_t>(in.get_varint()) + UnixGlyphMissing;
+      if (advance != UnixCodepointUnknown) advances.emplace_back(charcode, advance);
+    }
+
+    for (uint64_t count = in.get_varint(); count > 0; count--) {
+      uint32_t charcode = static_cast<uint32_t>(in.get_varint());
+      advances.emplace_back(charcode, static_cast<int32_t>(in.get_varint()) + UnixGlyphMissing);
+    }
+  }
+
+  catch (std::exception& e) {
+    return false;
+  }
+
+  font.ascender = ascender;
+  font.descender = descender;
+  font.units_per_EM = units_per_EM;
+  font.notdef = notdef;
+  for (const auto& [charcode, advance] : advances)
+    font.advances.set(charcode, advance);
+
+  font.loaded = true;
+  return true;
+}
+
+void UnixMetricsCache::save(const std::vector<std::unique_ptr<UnixFont>>& fonts) {
+  if (path.empty()) return;
+
+  bool dirty = resolutionsDirty;
+  for (const auto& font : fonts)
+    dirty = dirty || font->dirty;
+  if (!dirty) return;
+
+  std::string data;
+  Drawing_BinaryWriter out(data);
+  out.put_u32(UnixMetricsCacheMagic);
+  out.put_varint(UnixMetricsCacheVersion);
+
+  out.put_string(UnixFontConfigFingerprint());
+  out.put_varint(resolutions.size());
+  for (const auto& [request, details] : resolutions) {
+    out.put_string(std::get<0>(request));
+    out.put_u8(static_cast<uint8_t>(std::get<1>(request) | (std::get<2>(request) << 1)));
+    out.put_string(details.file);
+    out.put_varint(static_cast<uint64_t>(details.index));
+    out.put_string(details.fontfamily);
+    out.put_string(details.style);
+    out.put_string(details.name);
+  }
+
+  std::unordered_map<std::string, bool> written;
+  std::string record;
+  Drawing_BinaryWriter rec(record);
+  std::vector<std::pair<uint32_t, int32_t>> other;
+
+  for (const auto& font : fonts) {
+    if (!font->loaded || font->details.file.empty() || written[font->details.face()]) continue;
+    written[font->details.face()] = true;
+
+    record.clear();
+    rec.put_string(font->details.file);
+    rec.put_varint(static_cast<uint64_t>(font->details.index));
+    rec.put_svarint(font->mtime);
+    rec.put_varint(font->size);
+    rec.put_svarint(font->ascender);
+    rec.put_svarint(font->descender);
+    rec.put_varint(font->units_per_EM);
+    rec.put_varint(font->notdef);
+
+    // Other threads may still be adding advances, so one snapshot is written
+    std::array<int32_t, 256> latin1;
+    latin1.fill(UnixCodepointUnknown);
+    other.clear();
+    font->advances.forEach([&](uint32_t charcode, int32_t advance) {
+      if (charcode < latin1.size())
+        latin1[charcode] = advance;
+      else
+        other.emplace_back(charcode, advance);
+    });
+
+    for (auto advance : latin1)
+      rec.put_varint(static_cast<uint64_t>(advance - UnixGlyphMissing));
+
+    rec.put_varint(other.size());
+    for (const auto& [charcode, advance] : other) {
+      rec.put_varint(charcode);
+      rec.put_varint(static_cast<uint64_t>(advance - UnixGlyphMissing));
+    }
+
+    out.put_varint(record.size());
+    data.append(record);
+  }
+
+  // Fonts not used in this session keep their previous records
+  for (const auto& [face, bytes] : records) {
+    if (written.count(face)) continue;
+    out.put_varint(bytes.second);
+    data.append(reinterpret_cast<const char *>(bytes.first), bytes.second);
+  }
+
+  std::string temporary = path + ".tmp" + std::to_string(getpid());
+  std::FILE *cache = std::fopen(temporary.c_str(), "wb");
+  if (cache == nullptr) return;
+
+  bool saved = std::fwrite(data.data(), 1, data.size(), cache) == data.size();
+  saved = (std::fclose(cache) == 0) && saved;
+
+  // The mapping of the old file stays valid after the rename replaces it
+  if (!saved || (std::rename(temporary.c_str(), path.c_str()) != 0)) {
+    std::remove(temporary.c_str());
+    return;
+  }
+
+  // Fonts stay loaded for later devices, which only need to save what they measure
+  for (const auto& font : fonts)
+    font->dirty = false;
+  resolutionsDirty = false;
+}
+
+bool UnixDeviceDriver::PlatformTextBoundingRect(const std::string& family, const bool bold, const bool italic, const double pointsize,
+                                                const std::string& text, const bool UTF8, const bool symbol,
+                                                Drawing_TextBounds& bounds) {
+
+  bounds.ascent = bounds.descent = bounds.width = bounds.height = 0;
+
+#ifndef DRAWING_HARFBUZZ
+  // The core Office fonts are measured without any font I/O; FreeType handles other families
+  if (!symbol && CoreFontTextBoundingRect(family, bold, italic, pointsize, text, UTF8, bounds)) return true;
+#endif
+
+  UnixFont *current = last;
+
+  try {
+    if ((current == nullptr) || (current->family != family) || (current->bold != bold) || (current->italic != italic))
+      last = current = fonts->LoadFont(family, bold, italic, faces);
+  }
+
+  catch (std::exception& e) {
+    current = nullptr;
+  }
+
+  if ((current == nullptr) || !current->loaded) {
+#ifdef DRAWING_HARFBUZZ
+    // Shaping needs the font file, so the built-in metrics are only used when it cannot be loaded
+    return !symbol && CoreFontTextBoundingRect(family, bold, italic, pointsize, text, UTF8, bounds);
+#else
+    return false;
+#endif
+  }
+
+  double total_advance = 0;
+
+  try {
+#ifdef DRAWING_HARFBUZZ
+    total_advance = faces.ShapedAdvance(*current, text, UTF8, [&](uint32_t charcode) {
+      return fonts->MissingAdvance(*current, charcode, faces);
+    });
+#else
+    if (!UTF8 || Drawing_IsASCII(text.data(), text.size())) {
+      for (char c : text)
+        total_advance += fonts->Advance(*current, static_cast<uint8_t>(c), faces);
+    } else {
+      const char *pos = text.data();
+      const char *end = pos + text.size();
+      uint32_t charcode;
+
+      // Measurement stops at the first invalid sequence
+      while (Drawing_NextCodepoint(pos, end, charcode))
+        total_advance += fonts->Advance(*current, charcode, faces);
+    }
+#endif
+  }
+
+  catch (std::exception& e) {
+    return false;
+  }
+
+  bounds.ascent = static_cast<double>(current->ascender) / static_cast<double>(current->units_per_EM) * pointsize;
+  bounds.descent = static_cast<double>(current->descender) / static_cast<double>(current->units_per_EM) * pointsize;
   bounds.height = bounds.ascent - bounds.descent;
-  bounds.width = total_advance;
+  // Advances are in font units and scale linearly with the point size (72 DPI => pixels = points)
+  bounds.width = total_advance / static_cast<double>(current->units_per_EM) * pointsize;
 
   return true;
 }
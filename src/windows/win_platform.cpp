@@ -25,6 +25,10 @@ std::unique_ptr<PlatformDeviceDriver> NewPlatformDeviceDriver() {
   return std::make_unique<WindowsDeviceDriver>();
 }
 
+std::unique_ptr<PlatformDeviceDriver> NewPlatformTextMeasurer() {
+  return nullptr;
+}
+
 WindowsDeviceDriver::WindowsDeviceDriver() {
 }
 
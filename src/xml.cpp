@@ -1,27 +1,25 @@
 #include "xml.h"
-#include <sstream>
-#define UTF_CPP_CPLUSPLUS 201703L
-#include "utf8.h"
+#include "text_scan.h"
 
-XMLNode::XMLNode(const std::string& name) {
-  this->name = name;
-}
+XMLNode::XMLNode(std::string name) : name(std::move(name)) {}
 
-XMLNode::XMLNode(const std::string& name, const std::string& text) {
-  this->name = name;
-  this->text = text;
-}
+XMLNode::XMLNode(std::string name, std::string text) : name(std::move(name)), text(std::move(text)) {}
 
-XMLNode::XMLNode(const std::string& name, const std::vector<std::pair<std::string, std::string>>& attributes) {
-  this->name = name;
-  this->attributes = attributes;
-}
+XMLNode::XMLNode(std::string name, std::vector<std::pair<std::string, std::string>> attributes) :
+  name(std::move(name)), attributes(std::move(attributes)) {}
+
+XMLNode::XMLNode(std::string name, std::vector<std::pair<std::string, std::string>> attributes, std::string text) :
+  name(std::move(name)), text(std::move(text)), attributes(std::move(attributes)) {}
+
+void XMLNode::append(std::vector<XMLNode>&& children) {
+  if (nodes.empty()) {
+    nodes = std::move(children);
+    return;
+  }
 
-XMLNode::XMLNode(const std::string& name, const std::vector<std::pair<std::string, std::string>>& attributes,
-                 const std::string& text) {
-  this->name = name;
-  this->attributes = attributes;
-  this->text = text;
+  nodes.reserve(nodes.size() + children.size());
+  for (auto &child : children)
+    nodes.push_back(std::move(child));
 }
 
 bool XMLNode::empty() const {
@@ -30,63 +28,128 @@ bool XMLNode::empty() const {
 
 std::string XMLNode::XMLText(const std::string& str) {
   std::string result;
+  result.reserve(str.size());
+  XMLWriter::escape(result, str);
 
-  std::string::const_iterator b = str.begin();
-  std::string::const_iterator e = str.end();
-
-  try {
-    while (b != e) {
-      uint32_t charcode;
-      charcode = utf8::next(b, e);
-      if (charcode == '<') result += "&lt;";
-      else if (charcode == '>') result += "&gt;";
-      else if (charcode == '&') result += "&amp;";
-      else if (charcode == '\"') result += "&quot;";
-      else if (charcode == '\'') result += "&apos;";
-      else if (charcode < 32) result += "&#" + std::to_string(charcode) + ";";
-      else utf8::append(charcode, std::back_inserter(result));
-    }
-  }
+  return result;
+}
 
-  catch (std::exception& e) {
-  }
+std::string XMLNode::write() const {
+  std::string out;
+  out.reserve(length());
+  write(out);
+
+  return out;
+}
+
+void XMLNode::write(std::string& out) const {
+  XMLWriter writer(out);
+  write(writer);
+}
+
+void XMLNode::write(XMLWriter& out) const {
+  if (name.empty()) return;
+
+  out.startElement(name);
+  for (const auto& [attr_name, attr_value] : attributes)
+    out.attribute(attr_name, attr_value);
+
+  for (const auto& node : nodes)
+    node.write(out);
+
+  out.text(text);
+  out.endElement();
+}
+
+std::size_t XMLNode::length() const {
+  if (name.empty()) return 0;
+
+  std::size_t result = 2 * name.size() + 5 + text.size();
+  for (const auto& [attr_name, attr_value] : attributes)
+    result += attr_name.size() + attr_value.size() + 4;
+
+  for (const auto& node : nodes)
+    result += node.length();
 
   return result;
 }
 
-std::string XMLNode::write() const {
-  std::ostringstream out;
-
-  if (!name.empty()) {
-    out << "<" << name;
-    for (const auto& [attr_name, attr_value] : attributes) {
-      out << " " << attr_name << "=\"" << attr_value << "\"";
-    }
-
-    if (nodes.size() > 0) {
-      out << ">";
-      for (const auto& node : nodes)
-        out << node.write();
-
-      if (text.size() > 0) out << XMLText(text);
-
-      out << "</" << name << ">";
-    } else {
-
-      if (text.size() > 0) {
-        out << ">";
-        out << XMLText(text);
-        out << "</" << name << ">";
-      } else {
-        out << "/>";
-      }
-    }
+XMLWriter::XMLWriter(std::string &out) : out(out), in_start(false) {}
+
+void XMLWriter::closeStart() {
+  if (in_start) {
+    out += '>';
+    in_start = false;
+  }
+}
+
+XMLWriter& XMLWriter::startElement(const std::string& name) {
+  closeStart();
+  out += '<';
+  out += name;
+  open.push_back(name);
+  in_start = true;
+
+  return *this;
+}
+
+XMLWriter& XMLWriter::attribute(const std::string& name, const std::string& value) {
+  out += ' ';
+  out += name;
+  out += "=\"";
+  escape(out, value);
+  out += '"';
+
+  return *this;
+}
+
+XMLWriter& XMLWriter::text(const std::string& str) {
+  if (str.empty()) return *this;
+
+  closeStart();
+  escape(out, str);
+
+  return *this;
+}
+
+XMLWriter& XMLWriter::endElement() {
+  if (in_start) {
+    out += "/>";
+    in_start = false;
+  } else {
+    out += "</";
+    out += open.back();
+    out += '>';
   }
 
-  return out.str();
+  open.pop_back();
+  return *this;
 }
 
-const std::vector<XMLNode> XMLNodes(const std::vector<XMLNode> &nodes) {
+void XMLWriter::escape(std::string& out, const std::string& str) {
+  const char *pos = str.data();
+  const char *end = pos + str.size();
+  bool ascii = Drawing_IsASCII(pos, str.size());
+
+  // Output stops at the first invalid UTF-8 sequence
+  while (pos != end) {
+    const char *start = pos;
+    uint32_t charcode;
+
+    if (ascii) charcode = static_cast<uint8_t>(*pos++);
+    else if (!Drawing_NextCodepoint(pos, end, charcode)) break;
+
+    if (charcode == '<') out += "&lt;";
+    else if (charcode == '>') out += "&gt;";
+    else if (charcode == '&') out += "&amp;";
+    else if (charcode == '\"') out += "&quot;";
+    else if (charcode == '\'') out += "&apos;";
+    else if (charcode < 32) out += "&#" + std::to_string(charcode) + ";";
+    else out.append(start, pos);
+  }
+}
+
+std::vector<XMLNode> XMLNodes(std::vector<XMLNode> nodes) {
   return nodes;
 }
 
@@ -107,16 +170,18 @@ void XML::setRoot(XMLNode &root) {
 }
 
 void XML::setRoot(XMLNode &&root) {
-  this->root = root;
+  this->root = std::move(root);
 }
 
-std::string XML::write() {
-  std::ostringstream out;
+std::string XML::declaration() const {
+  return "<?xml version=\"" + version + "\" encoding=\"" + encoding + "\" standalone=\"" + standalone + "\"?>\n";
+}
 
-  out << "<?xml version=\"" << version << "\" encoding=\"" << encoding << "\" standalone=\"" << standalone << "\"?>\n";
+std::string XML::write() {
+  std::string out = declaration();
 
-  if (!root.empty())
-    out << root.write();
+  out.reserve(out.size() + root.length());
+  root.write(out);
 
-  return out.str();
+  return out;
 }
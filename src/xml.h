@@ -1,8 +1,10 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <utility>
 
 class XMLNode;
+class XMLWriter;
 
 class XMLNode {
   std::string name;
@@ -12,17 +14,29 @@ class XMLNode {
 
 public:
   XMLNode() = default;
-  XMLNode(const std::string& name);
-  XMLNode(const std::string& name, const std::string& text);
-  XMLNode(const std::string& name, const std::vector<std::pair<std::string, std::string>>& attributes);
-  XMLNode(const std::string& name, const std::vector<std::pair<std::string, std::string>>& attributes, const std::string& text);
+  XMLNode(std::string name);
+  XMLNode(std::string name, std::string text);
+  XMLNode(std::string name, std::vector<std::pair<std::string, std::string>> attributes);
+  XMLNode(std::string name, std::vector<std::pair<std::string, std::string>> attributes, std::string text);
   std::string write() const;
+  // Appends the element and its children to out, without intermediate strings
+  void write(std::string& out) const;
+  // Approximate length of the written element, for reserving output
+  std::size_t length() const;
   bool empty() const;
   static std::string XMLText(const std::string& str);
 
-  friend XMLNode& operator<<(XMLNode&& parent, const XMLNode& child) {
+  // Children are copied only when given as lvalues. A temporary parent is returned
+  // as an rvalue, so chains such as XMLNode("a") << XMLNode("b") << XMLNode("c")
+  // move the built subtree into whatever they initialise.
+  friend XMLNode&& operator<<(XMLNode&& parent, const XMLNode& child) {
     parent.nodes.push_back(child);
-    return parent;
+    return std::move(parent);
+  }
+
+  friend XMLNode&& operator<<(XMLNode&& parent, XMLNode&& child) {
+    parent.nodes.push_back(std::move(child));
+    return std::move(parent);
   }
 
   friend XMLNode& operator<<(XMLNode& parent, const XMLNode& child) {
@@ -30,23 +44,61 @@ public:
     return parent;
   }
 
-  friend XMLNode& operator<<(XMLNode&& parent, const std::vector<XMLNode>& children) {
-    for (const auto &child : children)
-      parent.nodes.push_back(child);
-
+  friend XMLNode& operator<<(XMLNode& parent, XMLNode&& child) {
+    parent.nodes.push_back(std::move(child));
     return parent;
   }
 
+  friend XMLNode&& operator<<(XMLNode&& parent, const std::vector<XMLNode>& children) {
+    parent.nodes.insert(parent.nodes.end(), children.begin(), children.end());
+    return std::move(parent);
+  }
+
+  friend XMLNode&& operator<<(XMLNode&& parent, std::vector<XMLNode>&& children) {
+    parent.append(std::move(children));
+    return std::move(parent);
+  }
+
   friend XMLNode& operator<<(XMLNode& parent, const std::vector<XMLNode>& children) {
-    for (const auto &child : children)
-      parent.nodes.push_back(child);
+    parent.nodes.insert(parent.nodes.end(), children.begin(), children.end());
+    return parent;
+  }
 
+  friend XMLNode& operator<<(XMLNode& parent, std::vector<XMLNode>&& children) {
+    parent.append(std::move(children));
     return parent;
   }
 
+private:
+  void append(std::vector<XMLNode>&& children);
+  void write(XMLWriter& out) const;
+};
+
+// Writes XML as a stream of events, appending escaped bytes straight to a buffer
+// rather than building a tree. Elements are ended in reverse order of starting; an
+// element ended without content is written as an empty-element tag.
+class XMLWriter {
+  std::string &out;
+  std::vector<std::string> open;
+  bool in_start; // the innermost start tag still takes attributes
+
+  void closeStart();
+
+public:
+  XMLWriter(std::string &out);
+
+  XMLWriter& startElement(const std::string& name);
+  XMLWriter& attribute(const std::string& name, const std::string& value);
+  XMLWriter& text(const std::string& str);
+  XMLWriter& endElement();
+
+  std::size_t size() const { return out.size(); }
+
+  // Appends str with markup characters replaced by entities
+  static void escape(std::string& out, const std::string& str);
 };
 
-const std::vector<XMLNode> XMLNodes(const std::vector<XMLNode> &nodes);
+std::vector<XMLNode> XMLNodes(std::vector<XMLNode> nodes);
 
 class XML {
   std::string version;
@@ -60,6 +112,7 @@ public:
   void setRoot(XMLNode &root);
   void setRoot(XMLNode &&root);
 
+  std::string declaration() const;
   std::string write();
 };
 
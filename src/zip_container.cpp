@@ -4,6 +4,7 @@
 #include <fstream>
 #include "clipboard.h"
 #include "zip_file.hpp"
+#include "zip_container.h"
 
 // [[Rcpp::export]]
 void ZipAndSendToClipboard(Rcpp::Environment archive) {
@@ -35,18 +36,37 @@ void ZipAndSendToClipboard(Rcpp::Environment archive) {
   SendToClipboard(output);
 }
 
-void ZipAndSendToClipboard(const std::vector<std::pair<std::string, std::string>>& container) {
+std::vector<uint8_t> ZipContainer(const std::vector<std::pair<std::string, std::string>>& container, Drawing_Stats& stats) {
   miniz_cpp::zip_file zip;
+  std::vector<uint8_t> output;
 
-  for (const auto& [arc_name, arc_contents] : container)
-    zip.writestr(arc_name, arc_contents);
+  {
+    Drawing_ScopedTimer timer(stats, DRAWING_TIME_DEFLATE);
 
-  std::vector<uint8_t> output;
-  zip.save(output);
+    for (const auto& [arc_name, arc_contents] : container)
+      zip.writestr(arc_name, arc_contents);
+
+    zip.save(output);
+  }
 
+  stats.parts.clear();
+  for (const auto& info : zip.infolist())
+    stats.parts.push_back({info.filename, info.file_size, info.compress_size});
+  stats.archive_bytes = output.size();
+
+  return output;
+}
+
+void SendArchiveToClipboard(std::vector<uint8_t>& output, Drawing_Stats& stats) {
   std::ofstream fzip("/Users/michael/clip3/test_clip.zip", std::ios::out | std::ios::binary);
   fzip.write((char *)output.data(), output.size());
   fzip.close();
 
+  Drawing_ScopedTimer timer(stats, DRAWING_TIME_CLIPBOARD);
   SendToClipboard(output);
 }
+
+void ZipAndSendToClipboard(const std::vector<std::pair<std::string, std::string>>& container, Drawing_Stats& stats) {
+  std::vector<uint8_t> output = ZipContainer(container, stats);
+  SendArchiveToClipboard(output, stats);
+}
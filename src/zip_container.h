@@ -1,3 +1,9 @@
 #pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "stats.h"
 
-void ZipAndSendToClipboard(const std::vector<std::pair<std::string, std::string>>& container);
+std::vector<uint8_t> ZipContainer(const std::vector<std::pair<std::string, std::string>>& container, Drawing_Stats& stats);
+void SendArchiveToClipboard(std::vector<uint8_t>& archive, Drawing_Stats& stats);
+void ZipAndSendToClipboard(const std::vector<std::pair<std::string, std::string>>& container, Drawing_Stats& stats);
@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+"""Generates src/core_metrics.h, the built-in metrics for the core Office fonts.
+
+Advance widths are those of the Adobe Core 14 AFM files (Helvetica, Times and
+Courier families), in 1/1000 em. Arial, Times New Roman and Courier New are
+metric-compatible with them over Latin-1. Ascent and descent are the hhea
+values of the Office fonts, also in 1/1000 em. Accented Latin-1 letters share
+the advance of their base letter.
+
+    python3 tools/core_metrics.py > src/core_metrics.h
+"""
+
+# Printable ASCII, 32 (space) to 126 (asciitilde)
+ASCII = {
+    "Helvetica": """
+        278 278 355 556 556 889 667 191 333 333 389 584 278 333 278 278
+        556 556 556 556 556 556 556 556 556 556 278 278 584 584 584 556
+        1015 667 667 722 722 667 611 778 722 278 500 667 556 833 722 778
+        667 778 722 667 611 722 667 944 667 667 611 278 278 278 469 556
+        333 556 556 500 556 556 278 556 556 222 222 500 222 833 556 556
+        556 556 333 500 278 556 500 722 500 500 500 334 260 334 584""",
+    "Helvetica-Bold": """
+        278 333 474 556 556 889 722 238 333 333 389 584 278 333 278 278
+        556 556 556 556 556 556 556 556 556 556 333 333 584 584 584 611
+        975 722 722 722 722 667 611 778 722 278 556 722 611 833 722 778
+        667 778 722 667 611 722 667 944 667 667 611 333 278 333 584 556
+        333 556 611 556 611 556 333 611 611 278 278 556 278 889 611 611
+        611 611 389 556 333 611 556 778 556 556 500 389 280 389 584""",
+    "Times-Roman": """
+        250 333 408 500 500 833 778 180 333 333 500 564 250 333 250 278
+        500 500 500 500 500 500 500 500 500 500 278 278 564 564 564 444
+        921 722 667 667 722 611 556 722 722 333 389 722 611 889 722 722
+        556 722 667 556 611 722 722 944 722 722 611 333 278 333 469 500
+        333 444 500 444 500 444 333 500 500 278 278 500 278 778 500 500
+        500 500 333 389 278 500 500 722 500 500 444 480 200 480 541""",
+    "Times-Bold": """
+        250 333 555 500 500 1000 833 278 333 333 500 570 250 333 250 278
+        500 500 500 500 500 500 500 500 500 500 333 333 570 570 570 500
+        930 722 667 722 722 667 611 778 778 389 500 778 667 944 722 778
+        611 778 722 556 667 722 722 1000 722 722 667 333 278 333 581 500
+        333 500 556 444 556 444 333 500 556 278 333 556 278 833 556 500
+        556 556 444 389 333 556 500 722 500 500 444 394 220 394 520""",
+    "Times-Italic": """
+        250 333 420 500 500 833 778 214 333 333 500 675 250 333 250 278
+        500 500 500 500 500 500 500 500 500 500 333 333 675 675 675 500
+        920 611 611 667 722 611 611 722 722 333 444 667 556 833 667 722
+        611 722 611 500 556 722 611 833 611 556 556 389 278 389 422 500
+        333 500 500 444 500 444 278 500 500 278 278 444 278 722 500 500
+        500 500 389 389 278 500 444 667 444 444 389 400 275 400 541""",
+    "Times-BoldItalic": """
+        250 389 555 500 500 833 778 278 333 333 500 570 250 333 250 278
+        500 500 500 500 500 500 500 500 500 500 333 333 570 570 570 500
+        832 667 667 667 722 667 667 722 778 389 500 667 611 889 722 722
+        611 722 667 556 611 722 667 889 667 611 611 333 278 333 570 500
+        333 500 500 444 500 444 333 500 556 278 278 500 278 778 556 500
+        500 500 389 389 278 556 444 667 500 444 389 348 220 348 570""",
+}
+
+# Latin-1 symbols, 160 (nbsp) to 191 (questiondown), then the letters that
+# don't take their width from a base letter: AE multiply Thorn germandbls ae
+# eth divide oslash thorn
+LATIN1 = {
+    "Helvetica": """
+        278 333 556 556 556 556 260 556 333 737 370 556 584 333 737 333
+        400 584 333 333 333 556 537 278 333 333 365 556 834 834 834 611
+        1000 584 667 611 889 556 584 611 556""",
+    "Helvetica-Bold": """
+        278 333 556 556 556 556 280 556 333 737 370 556 584 333 737 333
+        400 584 333 333 333 611 556 278 333 333 365 556 834 834 834 611
+        1000 584 667 611 889 611 584 611 611""",
+    "Times-Roman": """
+        250 333 500 500 500 500 200 500 333 760 276 500 564 333 760 333
+        400 564 300 300 333 500 453 250 333 300 310 500 750 750 750 444
+        889 564 556 500 667 500 564 500 500""",
+    "Times-Bold": """
+        250 333 500 500 500 500 220 500 333 747 300 500 570 333 747 333
+        400 570 300 300 333 556 540 250 333 300 330 500 750 750 750 500
+        1000 570 611 556 722 500 570 500 556""",
+    "Times-Italic": """
+        250 389 500 500 500 500 275 500 333 760 276 500 675 333 760 333
+        400 675 300 300 333 500 523 250 333 300 310 500 750 750 750 500
+        889 675 611 500 667 500 675 500 500""",
+    "Times-BoldItalic": """
+        250 389 500 500 500 500 220 500 333 747 266 500 606 333 747 333
+        400 570 300 300 333 576 500 250 333 300 300 500 750 750 750 500
+        944 570 611 500 722 500 570 500 500""",
+}
+
+# Base letter of each Latin-1 letter from 192 to 255, None for those in LATIN1.
+# Accented i is built on dotlessi, which is 278 in all six fonts.
+DOTLESSI = "\u0131"
+BASES = (
+    "AAAAAA", None, "C", "EEEE", "IIII", "D", "N", "OOOOO", None, "O", "UUUU", "Y",
+    None, None, "aaaaaa", None, "c", "eeee", DOTLESSI * 4, None, "n", "ooooo", None, None,
+    "uuuu", "y", None, "y",
+)
+
+# family, bold, italic, AFM metrics, hhea ascent, hhea descent
+FONTS = [
+    ("Arial", False, False, "Helvetica", 905, -212),
+    ("Arial", True, False, "Helvetica-Bold", 905, -212),
+    ("Arial", False, True, "Helvetica", 905, -212),
+    ("Arial", True, True, "Helvetica-Bold", 905, -212),
+    ("Times New Roman", False, False, "Times-Roman", 891, -216),
+    ("Times New Roman", True, False, "Times-Bold", 891, -216),
+    ("Times New Roman", False, True, "Times-Italic", 891, -216),
+    ("Times New Roman", True, True, "Times-BoldItalic", 891, -216),
+    ("Courier New", False, False, None, 833, -300),
+    ("Courier New", True, False, None, 833, -300),
+    ("Courier New", False, True, None, 833, -300),
+    ("Courier New", True, True, None, 833, -300),
+]
+
+
+def widths(metrics):
+    table = [0] * 256
+    if metrics is None:
+        for code in list(range(32, 127)) + list(range(160, 256)):
+            table[code] = 600
+        return table
+
+    ascii_widths = [int(w) for w in ASCII[metrics].split()]
+    latin1 = [int(w) for w in LATIN1[metrics].split()]
+    assert len(ascii_widths) == 95 and len(latin1) == 41, metrics
+
+    for idx, w in enumerate(ascii_widths):
+        table[32 + idx] = w
+    for idx, w in enumerate(latin1[:32]):
+        table[160 + idx] = w
+
+    others = iter(latin1[32:])
+    code = 192
+    for base in BASES:
+        for letter in (base if base else [None]):
+            if letter is None:
+                table[code] = next(others)
+            elif letter == DOTLESSI:
+                table[code] = 278
+            else:
+                table[code] = table[ord(letter)]
+            code += 1
+    assert code == 256
+
+    return table
+
+
+def main():
+    print("// Generated by tools/core_metrics.py -- do not edit by hand")
+    print("// Latin-1 advance widths, ascent and descent of the core Office fonts, in 1/1000 em")
+    print("#pragma once")
+    print("#include <cstdint>")
+    print("")
+    print("struct Drawing_CoreFont {")
+    print("  const char *family;")
+    print("  bool bold;")
+    print("  bool italic;")
+    print("  int16_t ascent;")
+    print("  int16_t descent;")
+    print("  uint16_t widths[256];")
+    print("};")
+    print("")
+    print("constexpr Drawing_CoreFont Drawing_CoreFonts[] = {")
+    for family, bold, italic, metrics, ascent, descent in FONTS:
+        table = widths(metrics)
+        print("  {\"%s\", %s, %s, %d, %d, {" % (family, "true" if bold else "false",
+                                              "true" if italic else "false", ascent, descent))
+        for row in range(0, 256, 16):
+            print("    " + ", ".join(str(w) for w in table[row:row + 16]) + ("," if row < 240 else ""))
+        print("  }},")
+    print("};")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,111 @@
+// Counts heap allocations made building XMLNode trees shaped like the DrawingML
+// shapes (a text box and a rectangle), per shape, and the time taken to build and
+// write them.
+//
+//     g++ -std=c++17 -O2 -Isrc tools/xml_alloc_bench.cpp src/xml.cpp src/text_scan.cpp -o xml_alloc_bench
+//     ./xml_alloc_bench [shapes]
+
+#include "xml.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static std::size_t allocations = 0;
+static std::size_t allocated = 0;
+
+void *operator new(std::size_t size) {
+  allocations++;
+  allocated += size;
+  if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+static XMLNode Bench_nvSpPr(int id) {
+  return
+    XMLNode("a:nvSpPr") <<
+      XMLNode("a:cNvPr", {{"id",std::to_string(id)},{"name",""}}) <<
+      XMLNode("a:cNvSpPr");
+}
+
+static XMLNode Bench_xfrm() {
+  return
+    XMLNode("a:xfrm") <<
+      XMLNode("a:off", {{"x","127000"},{"y","127000"}}) <<
+      XMLNode("a:ext", {{"cx","889000"},{"cy","254000"}});
+}
+
+static XMLNode Bench_solidFill() {
+  return
+    XMLNode("a:solidFill") << (
+      XMLNode("a:srgbClr", {{"val","0000FF"}}) <<
+        XMLNode("a:alpha", {{"val","100000"}}));
+}
+
+static XMLNode Bench_Rect(int id) {
+  return
+    XMLNode("a:sp") <<
+      Bench_nvSpPr(id) <<
+      (XMLNode("a:spPr") <<
+        Bench_xfrm() <<
+        XMLNode("a:prstGeom", {{"prst","rect"}}) <<
+        Bench_solidFill() <<
+        (XMLNode("a:ln", {{"w","12700"}}) <<
+          Bench_solidFill() <<
+          XMLNode("a:prstDash", {{"val","solid"}})));
+}
+
+static XMLNode Bench_Text(int id) {
+  return
+    XMLNode("a:sp") <<
+      Bench_nvSpPr(id) <<
+      (XMLNode("a:spPr") <<
+        Bench_xfrm() <<
+        XMLNode("a:prstGeom", {{"prst","rect"}}) <<
+        XMLNode("a:noFill")) <<
+      (XMLNode("a:txSp") <<
+        (XMLNode("a:txBody") <<
+          (XMLNode("a:bodyPr", {{"wrap","none"},{"lIns","0"},{"tIns","0"},{"rIns","0"},
+                                {"bIns","0"},{"anchor","b"},{"anchorCtr","1"}}) <<
+            XMLNode("a:spAutoFit")) <<
+          (XMLNode("a:p") <<
+            XMLNode("a:pPr", {{"algn","ctr"}}) <<
+            (XMLNode("a:r") <<
+              (XMLNode("a:rPr", {{"sz","1200"},{"b","0"},{"i","0"},{"dirty","0"}}) <<
+                Bench_solidFill() <<
+                XMLNode("a:latin", {{"typeface","Arial"}}) <<
+                XMLNode("a:cs", {{"typeface","Arial"}})) <<
+              XMLNode("a:t", "label " + std::to_string(id))))) <<
+        XMLNode("a:useSpRect"));
+}
+
+int main(int argc, char **argv) {
+  int shapes = (argc > 1) ? std::atoi(argv[1]) : 100000;
+
+  auto started = std::chrono::steady_clock::now();
+  std::size_t start_allocations = allocations;
+  std::size_t start_allocated = allocated;
+
+  XMLNode root("a:grpSp");
+  for (int id = 0; id < shapes; id++)
+    root << ((id % 2) ? Bench_Rect(id) : Bench_Text(id));
+
+  std::size_t build_allocations = allocations - start_allocations;
+  std::size_t build_allocated = allocated - start_allocated;
+  double build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  started = std::chrono::steady_clock::now();
+  XML doc;
+  doc.setRoot(std::move(root));
+  std::string out = doc.write();
+  double write_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  std::printf("shapes %d, %zu bytes of XML\n", shapes, out.size());
+  std::printf("build: %.1f allocations, %.0f bytes allocated per shape, %.3f s\n",
+              static_cast<double>(build_allocations) / shapes, static_cast<double>(build_allocated) / shapes, build_seconds);
+  std::printf("write: %.3f s\n", write_seconds);
+  return 0;
+}